@@ -3,6 +3,7 @@
 // Implements the logic of VCR (loading and parsing movies, managing current movie state etc.)
 
 #include "m64.h"
+#include "st_delta.h"
 #include "VCR.h"
 
 #include <cstdio>
@@ -10,6 +11,9 @@
 #include <vector>
 #include <cstring>
 
+#include <SDL.h>
+#include <SDL_thread.h>
+
 extern "C" {
 #include "api/m64p_types.h"
 #include "api/callbacks.h"
@@ -19,16 +23,19 @@ extern "C" {
 #include "main/main.h"
 #include "plugin/plugin.h" //for controls
 #include "main/rom.h"
+#include "greenzone.h"
 }
 
 const char* VCR_LoadStateErrors[] = {
 	"no error", //0 index
 	"not from this movie.",
 	"frame number out of range.",
-	"invalid format"
+	"invalid format",
+	"inputs differ from the movie it was saved with."
 };
 
 #define BUFFER_GROWTH 256
+#define JOURNAL_FLUSH_SAMPLES 60 //data lost on a crash is bounded to this many samples
 
 //either holds current movie's path, or last movie. This could be initialised from config and have "load last m64" option?
 static char moviePath[PATH_MAX] = { 0 };
@@ -37,11 +44,44 @@ static std::vector<BUTTONS> *gMovieBuffer = NULL; //holds reference to m64 data
 static SMovieHeader* gMovieHeader = NULL;
 static FILE* gMovieFile = NULL;
 
+//Read-only playback reads inputs straight from a mapping of the m64, so long movies
+//start instantly and concurrent players share the page cache. The inputs are copied
+//to gMovieBuffer once the movie becomes read-write.
+static const BUTTONS* gMovieMap = NULL;
+static size_t gMovieMapSamples = 0;
+static void* gMovieMapHandle = NULL;
+
+//Inputs of the movie as it was started. With compact states, a .st only stores the
+//samples that differ from them, plus a hash of the prefix they have in common.
+static std::vector<BUTTONS> gMovieBase;
+static std::vector<uint64_t> gMovieBaseHash; //[i] is the hash of the first i base samples
+static size_t gMovieMatched = 0; //gMovieBuffer starts with this many base samples
+static bool gCompactStates = false;
+
 static m64p_vcr_state VCR_state = M64VCR_IDLE;
 static bool VCR_readonly;
 static unsigned curSample = 0; //doesnt account in for multiple controllers, used as a pointer for vector
 static unsigned curVI = 0; //keeps track of VIs in a movie
 
+//Write-behind journal: while a movie is read-write, each finished sample is
+//collected here and written to the m64 by a background thread, along with
+//the header counters. Stopping only has to wait for the last batch.
+struct JournalBatch {
+	uint32_t first; //index of the first sample
+	std::vector<BUTTONS> samples;
+	uint32_t length_vis;
+	uint32_t length_samples;
+};
+
+static struct {
+	SDL_Thread* thread;
+	SDL_mutex* lock;
+	SDL_cond* cond;
+	std::vector<JournalBatch> queue; //handed over to the thread
+	JournalBatch pending; //filled by the emulation thread
+	bool quit;
+} journal;
+
 struct {
     BUTTONS buttons[4] {};
     bool channelHasOverlay[4] {};  // no clue what the compiler will do here
@@ -85,6 +125,120 @@ static void SetVCRState(m64p_vcr_state state) {
         VCR_StateCallback(M64VCRP_STATE, state);
 }
 
+static int VCR_JournalThread(void*)
+{
+	std::vector<JournalBatch> batches;
+
+	for (;;)
+	{
+		SDL_LockMutex(journal.lock);
+		while (journal.queue.empty() && !journal.quit)
+			SDL_CondWait(journal.cond, journal.lock);
+		if (journal.queue.empty())
+		{
+			SDL_UnlockMutex(journal.lock);
+			break;
+		}
+		batches.swap(journal.queue);
+		SDL_UnlockMutex(journal.lock);
+
+		for (const JournalBatch& batch : batches)
+		{
+			if (!batch.samples.empty())
+			{
+				fseek(gMovieFile, 1024 + batch.first * sizeof(BUTTONS), SEEK_SET);
+				fwrite(batch.samples.data(), sizeof(BUTTONS), batch.samples.size(), gMovieFile);
+			}
+		}
+		//counters of the latest batch, same offsets as VCR_SaveInputs
+		fseek(gMovieFile, 0xC, SEEK_SET);
+		fwrite(&batches.back().length_vis, sizeof(uint32_t), 1, gMovieFile);
+		fseek(gMovieFile, 0x18, SEEK_SET);
+		fwrite(&batches.back().length_samples, sizeof(uint32_t), 1, gMovieFile);
+		fflush(gMovieFile);
+		batches.clear();
+	}
+
+	return 0;
+}
+
+static bool VCR_JournalStart()
+{
+	journal.quit = false;
+	journal.pending.samples.clear();
+	journal.lock = SDL_CreateMutex();
+	journal.cond = SDL_CreateCond();
+	if (journal.lock != NULL && journal.cond != NULL)
+	{
+#if SDL_VERSION_ATLEAST(2,0,0)
+		journal.thread = SDL_CreateThread(VCR_JournalThread, "m64pvcr", NULL);
+#else
+		journal.thread = SDL_CreateThread(VCR_JournalThread, NULL);
+#endif
+	}
+	if (journal.thread == NULL)
+	{
+		if (journal.cond != NULL) SDL_DestroyCond(journal.cond);
+		if (journal.lock != NULL) SDL_DestroyMutex(journal.lock);
+		journal.cond = NULL;
+		journal.lock = NULL;
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Hands the pending samples and current header counters over to the journal thread
+/// </summary>
+static void VCR_JournalSubmit()
+{
+	journal.pending.length_vis = gMovieHeader->length_vis;
+	journal.pending.length_samples = gMovieHeader->length_samples;
+
+	SDL_LockMutex(journal.lock);
+	journal.queue.push_back(std::move(journal.pending));
+	SDL_CondSignal(journal.cond);
+	SDL_UnlockMutex(journal.lock);
+
+	journal.pending.samples.clear();
+}
+
+/// <summary>
+/// Queues a finished sample for writing, batches are submitted every JOURNAL_FLUSH_SAMPLES samples
+/// </summary>
+static void VCR_JournalWrite(uint32_t index, BUTTONS sample)
+{
+	if (!journal.pending.samples.empty() && index != journal.pending.first + journal.pending.samples.size())
+		VCR_JournalSubmit();
+	if (journal.pending.samples.empty())
+		journal.pending.first = index;
+
+	journal.pending.samples.push_back(sample);
+	if (journal.pending.samples.size() >= JOURNAL_FLUSH_SAMPLES)
+		VCR_JournalSubmit();
+}
+
+/// <summary>
+/// Writes everything still pending and stops the journal thread
+/// </summary>
+static void VCR_JournalStop()
+{
+	VCR_JournalSubmit();
+
+	SDL_LockMutex(journal.lock);
+	journal.quit = true;
+	SDL_CondSignal(journal.cond);
+	SDL_UnlockMutex(journal.lock);
+
+	SDL_WaitThread(journal.thread, NULL);
+	SDL_DestroyCond(journal.cond);
+	SDL_DestroyMutex(journal.lock);
+	journal.thread = NULL;
+	journal.cond = NULL;
+	journal.lock = NULL;
+	journal.queue.clear();
+}
+
 /// <summary>
 /// Looks at m64 header flags and does appropriate things to core before starting movie.
 /// Its used in start, restart and start recording, so its handy to have it as a helper function.
@@ -116,6 +270,71 @@ static void PrepareCore(const char* path)
 	}
 }
 
+static const BUTTONS* VCR_Inputs()
+{
+	return gMovieMap != NULL ? gMovieMap : gMovieBuffer->data();
+}
+
+static size_t VCR_InputCount()
+{
+	return gMovieMap != NULL ? gMovieMapSamples : gMovieBuffer->size();
+}
+
+static const BUTTONS* VCR_BaseInputs()
+{
+	return gMovieMap != NULL ? gMovieMap : gMovieBase.data();
+}
+
+static size_t VCR_BaseCount()
+{
+	return gMovieMap != NULL ? gMovieMapSamples : gMovieBase.size();
+}
+
+/// <summary>
+/// Hashes the first count samples of the base, count must not exceed VCR_BaseCount()
+/// </summary>
+static uint64_t VCR_BaseHash(size_t count)
+{
+	const BUTTONS* base = VCR_BaseInputs();
+
+	//hashes are extended on demand, the base never changes while the movie is active
+	if (gMovieBaseHash.empty())
+		gMovieBaseHash.push_back(0xcbf29ce484222325ull);
+	while (gMovieBaseHash.size() <= count)
+	{
+		uint64_t h = (gMovieBaseHash.back() ^ base[gMovieBaseHash.size() - 1].Value) * 0x100000001b3ull;
+		gMovieBaseHash.push_back(h ^ (h >> 29));
+	}
+	return gMovieBaseHash[count];
+}
+
+static void VCR_ClearBase()
+{
+	std::vector<BUTTONS>().swap(gMovieBase);
+	std::vector<uint64_t>().swap(gMovieBaseHash);
+	gMovieMatched = 0;
+}
+
+/// <summary>
+/// Drops the m64 mapping, optionally copying the mapped inputs into gMovieBuffer first
+/// </summary>
+static void VCR_UnmapInputs(bool copy)
+{
+	if (gMovieMap == NULL)
+		return;
+
+	if (copy)
+	{
+		//the file is about to change, the base needs its own copy
+		gMovieBase.assign(gMovieMap, gMovieMap + gMovieMapSamples);
+		*gMovieBuffer = gMovieBase;
+	}
+	osal_file_unmap(gMovieMapHandle);
+	gMovieMap = NULL;
+	gMovieMapSamples = 0;
+	gMovieMapHandle = NULL;
+}
+
 /// <summary>
 /// Updates input data (offset 1024) and header info about samples, writes however long the input buffer is
 /// </summary>
@@ -151,10 +370,18 @@ void VCR_StopMovie(BOOL restart)
 	{
 		if (VCR_IsPlaying())
 		{
+			//samples are already on disk unless the journal couldn't be started
+			bool journaled = journal.thread != NULL;
+			if (journaled)
+				VCR_JournalStop();
 			VCR_SaveMovieHeader(gMovieFile, gMovieHeader);
-			VCR_SaveInputs(gMovieFile);
+			if (!journaled)
+				VCR_SaveInputs(gMovieFile);
 
 			SetVCRState(M64VCR_IDLE);
+			VCR_UnmapInputs(false);
+			VCR_ClearBase();
+			greenzone_reset();
 			delete gMovieBuffer;
 			delete gMovieHeader;
 			gMovieBuffer = NULL;
@@ -171,8 +398,7 @@ void VCR_StopMovie(BOOL restart)
 	{
 		if (VCR_IsPlaying()) //no need to restart everything, just roll back
 		{
-			PrepareCore(moviePath);
-			curSample = 0;
+			VCR_RestartMovie();
 			VCR_SetReadOnly(true);
 		}
 		else //nothing is playing, load up saved path
@@ -184,8 +410,13 @@ void VCR_StopMovie(BOOL restart)
 }
 
 void VCR_SetOverlay(BUTTONS keys, unsigned channel) {
-    if (VCR_IsPlaying() && !VCR_IsReadOnly())
+    if (VCR_IsPlaying() && !VCR_IsReadOnly()) {
+        if ((*gMovieBuffer)[curSample].Value != keys.Value)
+            greenzone_invalidate(curSample);
         (*gMovieBuffer)[curSample].Value = keys.Value;
+        if (curSample < gMovieMatched && keys.Value != VCR_BaseInputs()[curSample].Value)
+            gMovieMatched = curSample;
+    }
     else
         overlay.buttons[channel] = keys;
 }
@@ -198,7 +429,7 @@ BOOL VCR_GetKeys(BUTTONS* keys, unsigned channel) {
     else {
         if (VCR_IsPlaying()) {
             if (gMovieHeader->cFlags.present & (1 << channel))
-                keys->Value = (*gMovieBuffer)[curSample].Value;
+                keys->Value = VCR_Inputs()[curSample].Value;
         }
         else if (input.getKeys) {
             // nothing to do, just read input plugin
@@ -227,10 +458,19 @@ unsigned int VCR_AdvanceFrame() {
         return 0;  // no movie
 
     VCR_ResetOverlay();
+    if (!VCR_IsReadOnly()) {
+        if (journal.thread != NULL)
+            VCR_JournalWrite(curSample, (*gMovieBuffer)[curSample]);
+        if (gMovieMatched == curSample && curSample < VCR_BaseCount() &&
+            (*gMovieBuffer)[curSample].Value == VCR_BaseInputs()[curSample].Value)
+            ++gMovieMatched;
+    }
     ++curSample;
+    if (!VCR_IsReadOnly() && curSample > gMovieHeader->length_samples)
+        gMovieHeader->length_samples = curSample; //the movie may go on past this after a seek
     // check if there are frames left
     // curSample is 0 indexed, so we must >= with size
-    if (curSample >= gMovieBuffer->size()) {
+    if (curSample >= VCR_InputCount()) {
         if (VCR_IsReadOnly()) {
             VCR_StopMovie(false);
             return 0;  // movie ended
@@ -258,6 +498,8 @@ BOOL VCR_IsReadOnly()
 BOOL VCR_SetReadOnly(BOOL state)
 {
 	VCR_Message(M64MSG_INFO, state ? "Read only" : "Read write");
+	if (!state)
+		VCR_UnmapInputs(true); //inputs are about to be overwritten
     if (VCR_StateCallback)
         VCR_StateCallback(M64VCRP_READONLY, state);
 
@@ -269,11 +511,111 @@ unsigned VCR_GetCurFrame()
 	if (!VCR_IsPlaying()) return -1;
 	return curSample / gMovieHeader->num_controllers;
 }
+
+unsigned VCR_GetCurSample()
+{
+	return curSample;
+}
+
+void VCR_RestartMovie()
+{
+	//after the first time, the state the movie starts from is restored from memory
+	if (!greenzone_request_restart())
+		PrepareCore(moviePath);
+	curSample = 0;
+}
+
+m64p_error VCR_SeekFrame(unsigned frame)
+{
+	if (!VCR_IsPlaying()) return M64ERR_INVALID_STATE;
+
+	//a read-only movie stops once its last frame is played
+	unsigned length = gMovieHeader->length_samples / gMovieHeader->num_controllers;
+	if (VCR_IsReadOnly() ? frame >= length : frame > length)
+		return M64ERR_INPUT_INVALID;
+
+	greenzone_seek(frame);
+	return M64ERR_SUCCESS;
+}
  
+void VCR_SetCompactStates(BOOL state)
+{
+	gCompactStates = state;
+}
+
+/// <summary>
+/// Compact form of the .st data: the usual 4 words, ST_DELTA_MAGIC, how many samples are
+/// shared with the base, their hash, then the samples from there up to the current one
+/// </summary>
+static size_t VCR_CollectSTDelta(uint32_t** buf)
+{
+	size_t prefix = gMovieMatched < curSample ? gMovieMatched : curSample;
+	size_t count = curSample + 1 - prefix;
+	//older cores must reject the state instead of taking it for a full copy
+	size_t words = ST_DeltaWords((uint32_t)prefix, curSample, gMovieHeader->length_samples);
+
+	*buf = (uint32_t*)calloc(words, sizeof(uint32_t));
+	if (*buf == NULL) return 0;
+
+	uint64_t hash = VCR_BaseHash(prefix);
+	uint32_t* p = *buf;
+	*p++ = gMovieHeader->uid;
+	*p++ = curSample;
+	*p++ = curVI;
+	*p++ = gMovieHeader->length_samples;
+	*p++ = ST_DELTA_MAGIC;
+	*p++ = (uint32_t)prefix;
+	*p++ = (uint32_t)hash;
+	*p++ = (uint32_t)(hash >> 32);
+	memcpy(p, VCR_Inputs() + prefix, count*sizeof(BUTTONS));
+	return words * sizeof(uint32_t);
+}
+
+static bool VCR_IsSTDelta(const uint32_t* buf, uint32_t savedCurSample, uint32_t sampleCount, unsigned len)
+{
+	if (len < 8 * sizeof(uint32_t) || buf[0] != ST_DELTA_MAGIC || buf[1] > savedCurSample)
+		return false;
+
+	return len == ST_DeltaWords(buf[1], savedCurSample, sampleCount) * sizeof(uint32_t);
+}
+
+/// <summary>
+/// Makes the movie the first prefix samples of the base followed by samples, up to end.
+/// Only the samples that changed are written to the buffer and the journal.
+/// </summary>
+static void VCR_ApplySamples(uint32_t prefix, const BUTTONS* samples, uint32_t end)
+{
+	const BUTTONS* base = VCR_BaseInputs();
+	size_t oldSize = gMovieBuffer->size();
+	//the buffer already starts with gMovieMatched base samples
+	uint32_t first = gMovieMatched < prefix ? (uint32_t)gMovieMatched : prefix;
+
+	gMovieBuffer->resize(end + BUFFER_GROWTH); //we dont care what's after this frame, there's m64 for that...
+	greenzone_invalidate(end); //the movie continues from here with new inputs
+	for (uint32_t i = first; i < end; ++i)
+	{
+		BUTTONS sample = i < prefix ? base[i] : samples[i - prefix];
+		if (i >= oldSize || (*gMovieBuffer)[i].Value != sample.Value)
+		{
+			greenzone_invalidate(i);
+			(*gMovieBuffer)[i] = sample;
+			if (journal.thread != NULL)
+				VCR_JournalWrite(i, sample);
+		}
+	}
+
+	size_t matched = prefix;
+	while (matched < end && matched < VCR_BaseCount() && samples[matched - prefix].Value == base[matched].Value)
+		++matched;
+	gMovieMatched = matched;
+}
+
 //saves inputs only up to current frame!!
 size_t VCR_CollectSTData(uint32_t** buf)
 {
 	if (!VCR_IsPlaying()) return 0; //don't try
+	if (gCompactStates)
+		return VCR_CollectSTDelta(buf);
 	//curSample+1 (because 0-index), then 4*4 bytes (this could be turned to a struct but its so small that eh) 
 	size_t len = (curSample + 1)*sizeof(BUTTONS) + 4 * sizeof(uint32_t);
 	*buf = (uint32_t*)malloc(len); 
@@ -284,7 +626,7 @@ size_t VCR_CollectSTData(uint32_t** buf)
 	*p++ = curSample;
 	*p++ = curVI;
 	*p++ = gMovieHeader->length_samples;
-	memcpy(p, gMovieBuffer->data(), (curSample+1)*sizeof(BUTTONS));
+	memcpy(p, VCR_Inputs(), (curSample+1)*sizeof(BUTTONS));
 	return len;
 }
 
@@ -298,17 +640,32 @@ int VCR_LoadMovieData(uint32_t* buf, unsigned len)
 	uint32_t savedVI = *buf++;
 	uint32_t SampleCount = *buf++;
 	BUTTONS* inputs = (BUTTONS*)buf; //there are savedSampleNum+1 bytes of inputs, one frame is garbage, can be ignored (when loading old st ofc)
+	bool delta = false;
 	if ((4 + savedCurSample +1) * 4 != len && (4 + SampleCount + 1) * 4 != len) //either savedCurSample or SampleCount should add up, otherwise its bad
-		return VCR_ST_WRONG_FORMAT;
+	{
+		//or it only has the samples that differ from the movie
+		if (!VCR_IsSTDelta(buf, savedCurSample, SampleCount, len))
+			return VCR_ST_WRONG_FORMAT;
+		delta = true;
+	}
 	if (UID != gMovieHeader->uid)
 		return VCR_ST_BAD_UID;
 	if (savedCurSample > SampleCount)
 		return VCR_ST_INVALID_FRAME;
 	//if readwrite, overwrite input buffer with new data, might need to resize
-	if (!VCR_IsReadOnly())
+	//seeking only moves around in the movie, whatever the mode
+	if (!VCR_IsReadOnly() && !greenzone_is_seeking())
 	{
-		//gMovieBuffer->assign(inputs, inputs + SampleCount);
-		gMovieBuffer->assign(inputs, inputs + savedCurSample); //we dont care what's after this frame, there's m64 for that...
+		if (delta)
+		{
+			uint32_t prefix = buf[1];
+			uint64_t hash = buf[2] | (uint64_t)buf[3] << 32;
+			if (prefix > VCR_BaseCount() || VCR_BaseHash(prefix) != hash)
+				return VCR_ST_INPUT_MISMATCH;
+			VCR_ApplySamples(prefix, (BUTTONS*)(buf + 4), savedCurSample);
+		}
+		else
+			VCR_ApplySamples(0, inputs, savedCurSample);
 	}
 	else
 	{
@@ -320,7 +677,12 @@ int VCR_LoadMovieData(uint32_t* buf, unsigned len)
 	}
 	curSample = savedCurSample;
 	curVI = savedVI;
-	if (!VCR_IsReadOnly()) gMovieHeader->length_samples = savedCurSample; //this is done in getkeys anyway, but for safety do it here too
+	if (!VCR_IsReadOnly() && !greenzone_is_seeking())
+	{
+		gMovieHeader->length_samples = savedCurSample; //this is done in getkeys anyway, but for safety do it here too
+		if (journal.thread != NULL)
+			VCR_JournalSubmit(); //the movie got shorter, patch the header now
+	}
 
 	return VCR_ST_SUCCESS;
 }
@@ -347,14 +709,32 @@ m64p_error VCR_StartMovie(const char* path)
 		return M64ERR_INTERNAL;
 	}
 
-	//create a vector with enough space
-	gMovieBuffer = new std::vector<BUTTONS>(gMovieHeader->length_samples * gMovieHeader->num_controllers);
-	if (gMovieBuffer == NULL)
+	size_t samples = (size_t)gMovieHeader->length_samples * gMovieHeader->num_controllers;
+	gMovieMap = (const BUTTONS*)osal_file_map(path, 1024, samples * sizeof(BUTTONS), &gMovieMapHandle);
+	if (gMovieMap != NULL)
 	{
-		fclose(gMovieFile);
-		return M64ERR_NO_MEMORY;
+		//inputs are read from the mapping until the movie becomes read-write
+		gMovieMapSamples = samples;
+		gMovieBuffer = new std::vector<BUTTONS>();
+		gMovieMatched = samples;
+	}
+	else
+	{
+		//create a vector with enough space
+		gMovieBuffer = new std::vector<BUTTONS>(samples);
+		if (gMovieBuffer == NULL)
+		{
+			fclose(gMovieFile);
+			return M64ERR_NO_MEMORY;
+		}
+		fread(gMovieBuffer->data(), sizeof(BUTTONS), gMovieBuffer->size(), gMovieFile);
+		gMovieBase = *gMovieBuffer;
+		gMovieMatched = samples;
 	}
-	fread(gMovieBuffer->data(), sizeof(BUTTONS), gMovieBuffer->size(), gMovieFile);
+
+	if (!VCR_JournalStart())
+		VCR_Message(M64MSG_WARNING, "Couldn't start movie journal, inputs will be written when the movie stops");
+	greenzone_reset();
 
 	PrepareCore(path);
 
@@ -372,7 +752,8 @@ m64p_error VCR_StartRecording(const char* path, const char* author, const char*
 {
 	//call VCR_StopMovie yourself
 	if (VCR_IsPlaying()) return M64ERR_INTERNAL;
-	gMovieFile = osal_file_open(path, "wb+");
+	//fails instead of truncating a movie played back from a mapping, here or in another process
+	gMovieFile = osal_file_open_truncate(path);
 	if (gMovieFile == NULL)
 	{
 		char msg[1024] = "SaveM64 error: ";
@@ -421,6 +802,11 @@ m64p_error VCR_StartRecording(const char* path, const char* author, const char*
 	gMovieHeader->romCountry = ROM_HEADER.Country_code;
 	//@TODO: save all the rest of the info, plugins etc
 	VCR_SaveMovieHeader(gMovieFile, gMovieHeader);
+	fflush(gMovieFile);
+
+	if (!VCR_JournalStart())
+		VCR_Message(M64MSG_WARNING, "Couldn't start movie journal, inputs will be written when the movie stops");
+	greenzone_reset();
 
 	strcpy(moviePath, path);
 	VCR_SetReadOnly(false);
@@ -432,6 +818,7 @@ m64p_error VCR_StartRecording(const char* path, const char* author, const char*
 }
 
 #undef BUFFER_GROWTH
+#undef JOURNAL_FLUSH_SAMPLES
 
 //if (m64) play
 //else no play
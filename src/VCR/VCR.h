@@ -23,7 +23,8 @@ typedef enum
 	VCR_ST_SUCCESS,
 	VCR_ST_BAD_UID,
 	VCR_ST_INVALID_FRAME,
-	VCR_ST_WRONG_FORMAT
+	VCR_ST_WRONG_FORMAT,
+	VCR_ST_INPUT_MISMATCH
 } VCRSTErrorCodes;
 
 extern const char* VCR_LoadStateErrors[];
@@ -45,6 +46,23 @@ size_t VCR_CollectSTData(uint32_t** dest);
 /// <returns> error value, can be used with VCR_stateErrors[err] to get text</returns>
 int VCR_LoadMovieData(uint32_t* buf, unsigned len);
 
+/// <summary>
+/// Makes VCR_CollectSTData store only the inputs that differ from the movie as it was started,
+/// with a hash of the rest. Such a .st can only be loaded with a movie that has the same inputs up to there.
+/// </summary>
+/// <param name="state">true or false</param>
+void VCR_SetCompactStates(BOOL state);
+
+/// <summary>
+/// Returns how many input samples of the movie were consumed, 0 if nothing is being played
+/// </summary>
+unsigned VCR_GetCurSample();
+
+/// <summary>
+/// Jumps back to the start of the active movie without changing read-only state
+/// </summary>
+void VCR_RestartMovie();
+
 #ifdef __cplusplus
 	}
 #endif
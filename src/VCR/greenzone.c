@@ -0,0 +1,510 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - greenzone.c                                             *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* The greenzone keeps snapshots of the emulator state during movie playback,
+ * keyed by movie frame, so that a seek only has to restore the closest earlier
+ * one and replay the frames left instead of the whole movie.
+ * A checkpoint is either a key holding a full snapshot, or a delta against the
+ * closest earlier key (see state_delta.c). When the memory budget is exceeded,
+ * the checkpoint that matters least is dropped: its worth is the gap its
+ * removal would leave, relative to the spacing wanted at its distance from the
+ * current frame. That spacing grows with the distance, so checkpoints stay
+ * dense around the current frame and get sparse far from it.
+ * The state the movie starts from is kept apart, whatever the budget, so that
+ * restarts don't have to reload the .st or reset the console again. */
+
+#include "greenzone.h"
+
+#include <SDL.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "VCR.h"
+#include "api/callbacks.h"
+#include "api/m64p_types.h"
+#include "api/m64p_vcr.h"
+#include "main/savestates.h"
+#include "main/state_delta.h"
+
+/* room left after a key for deltas of larger snapshots, the movie data in them grows */
+#define GREENZONE_KEY_SLACK (64 * 1024)
+/* the wanted spacing grows by one frame every this many frames away from the current one */
+#define GREENZONE_FALLOFF 16
+
+struct greenzone_checkpoint {
+    unsigned int frame;
+    unsigned int sample;    /* movie samples consumed when it was captured */
+    struct greenzone_checkpoint *key;   /* NULL if data is a full snapshot */
+    unsigned int refs;      /* deltas based on this key */
+    size_t state_size;
+    size_t length;          /* length of data in 32-bit words */
+    uint32_t data[];
+};
+
+/* seeks and restarts are requested from the frontend thread, a job is only
+ * cleared by the one handling it so that a newer request isn't lost */
+static SDL_atomic_t l_job;
+
+static unsigned int l_interval = 1;
+static size_t l_budget = 0;
+static size_t l_used = 0;
+
+/* checkpoints sorted by frame */
+static struct greenzone_checkpoint **l_points = NULL;
+static size_t l_count = 0;
+static size_t l_capacity = 0;
+
+/* requested by the VCR from either thread, applied by the emulation thread */
+static SDL_atomic_t l_reset;
+static SDL_atomic_t l_invalid_sample = { (int)UINT_MAX };
+
+/* set by seek requests from the frontend thread, cleared by the emulation thread */
+static SDL_atomic_t l_seeking;
+static SDL_atomic_t l_seek_frame;
+
+/* state before the movie consumed any input, empty until captured.
+ * l_has_start tells the frontend thread whether there is one. */
+static char *l_start = NULL;
+static size_t l_start_size = 0;
+static size_t l_start_capacity = 0;
+static SDL_atomic_t l_has_start;
+
+/* scratch buffer for snapshots */
+static char *l_state = NULL;
+static size_t l_state_capacity = 0;
+
+static size_t greenzone_checkpoint_size(const struct greenzone_checkpoint *point)
+{
+    return sizeof(*point) + point->length * sizeof(uint32_t);
+}
+
+/* Index of the first checkpoint past frame. */
+static size_t greenzone_upper_bound(unsigned int frame)
+{
+    size_t lo = 0, hi = l_count;
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (l_points[mid]->frame <= frame)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* Keys must not be removed before their deltas, which always come after them. */
+static void greenzone_remove(size_t i)
+{
+    struct greenzone_checkpoint *point = l_points[i];
+
+    if (point->key != NULL)
+        point->key->refs--;
+
+    l_used -= greenzone_checkpoint_size(point);
+    free(point);
+
+    memmove(&l_points[i], &l_points[i + 1], (l_count - i - 1) * sizeof(*l_points));
+    --l_count;
+}
+
+/* Drops the checkpoints that consumed more than 'sample' movie samples. */
+static void greenzone_drop_after(unsigned int sample)
+{
+    while (l_count > 0 && l_points[l_count - 1]->sample > sample)
+        greenzone_remove(l_count - 1);
+}
+
+static void greenzone_clear(void)
+{
+    while (l_count > 0)
+        greenzone_remove(l_count - 1);
+}
+
+static void greenzone_apply_requests(void)
+{
+    unsigned int sample;
+
+    if (SDL_AtomicCAS(&l_reset, 1, 0))
+    {
+        SDL_AtomicSet(&l_invalid_sample, (int)UINT_MAX);
+        SDL_AtomicSet(&l_has_start, 0);
+        l_start_size = 0;
+        greenzone_clear();
+    }
+
+    sample = (unsigned int)SDL_AtomicSet(&l_invalid_sample, (int)UINT_MAX);
+    if (sample != UINT_MAX)
+        greenzone_drop_after(sample);
+}
+
+static double greenzone_worth(size_t i, unsigned int frame)
+{
+    const struct greenzone_checkpoint *point = l_points[i];
+    unsigned int next = (i + 1 < l_count) ? l_points[i + 1]->frame : point->frame;
+    unsigned int distance = (point->frame > frame) ? point->frame - frame : frame - point->frame;
+
+    return (double)(next - l_points[i - 1]->frame) / (l_interval + (double)distance / GREENZONE_FALLOFF);
+}
+
+static void greenzone_trim(unsigned int frame)
+{
+    while (l_used > l_budget && l_count > 0)
+    {
+        size_t i, victim = 0;
+        double lowest = 0;
+
+        /* the first checkpoint goes last, no other one can replace it */
+        for (i = 1; i < l_count; ++i)
+        {
+            double worth;
+
+            if (l_points[i]->refs > 0)
+                continue;
+
+            worth = greenzone_worth(i, frame);
+            if (victim == 0 || worth < lowest)
+            {
+                victim = i;
+                lowest = worth;
+            }
+        }
+
+        greenzone_remove(victim);
+    }
+}
+
+static int greenzone_insert(size_t i, struct greenzone_checkpoint *point)
+{
+    if (l_count == l_capacity)
+    {
+        size_t capacity = (l_capacity > 0) ? l_capacity * 2 : 64;
+        struct greenzone_checkpoint **points = realloc(l_points, capacity * sizeof(*l_points));
+        if (points == NULL)
+            return 0;
+
+        l_points = points;
+        l_capacity = capacity;
+    }
+
+    memmove(&l_points[i + 1], &l_points[i], (l_count - i) * sizeof(*l_points));
+    l_points[i] = point;
+    ++l_count;
+
+    if (point->key != NULL)
+        point->key->refs++;
+    l_used += greenzone_checkpoint_size(point);
+    return 1;
+}
+
+static int greenzone_restore(const struct greenzone_checkpoint *point)
+{
+    const struct greenzone_checkpoint *key = (point->key != NULL) ? point->key : point;
+    size_t words = (point->state_size + 3) / 4;
+
+    if (!state_delta_pad(&l_state, &l_state_capacity, point->state_size, words))
+    {
+        DebugMessage(M64MSG_WARNING, "Insufficient memory to restore movie checkpoint.");
+        return 0;
+    }
+
+    memcpy(l_state, key->data, words * 4);
+    if (point->key != NULL)
+        state_delta_apply((uint32_t *)l_state, point->data, point->length);
+
+    return savestates_load_from_buffer(l_state, point->state_size);
+}
+
+void greenzone_init(unsigned int interval, unsigned int buffer_size_mb)
+{
+    greenzone_deinit();
+
+    l_interval = (interval > 0) ? interval : 1;
+    l_budget = (size_t)buffer_size_mb * 1024 * 1024;
+}
+
+void greenzone_deinit(void)
+{
+    SDL_AtomicSet(&l_job, greenzone_job_nothing);
+    l_budget = 0;
+    SDL_AtomicSet(&l_reset, 0);
+    SDL_AtomicSet(&l_invalid_sample, (int)UINT_MAX);
+    SDL_AtomicSet(&l_seeking, 0);
+    SDL_AtomicSet(&l_has_start, 0);
+    greenzone_clear();
+
+    free(l_points);
+    free(l_state);
+    free(l_start);
+    l_points = NULL;
+    l_state = l_start = NULL;
+    l_capacity = l_state_capacity = 0;
+    l_start_size = l_start_capacity = 0;
+}
+
+void greenzone_reset(void)
+{
+    SDL_AtomicSet(&l_reset, 1);
+    SDL_AtomicSet(&l_seeking, 0);
+}
+
+void greenzone_invalidate(unsigned int sample)
+{
+    int invalid;
+
+    /* keeps the lowest sample if both threads invalidate at once */
+    do
+    {
+        invalid = SDL_AtomicGet(&l_invalid_sample);
+        if ((unsigned int)invalid <= sample)
+            return;
+    } while (!SDL_AtomicCAS(&l_invalid_sample, invalid, (int)sample));
+}
+
+void greenzone_seek(unsigned int frame)
+{
+    SDL_AtomicSet(&l_seek_frame, (int)frame);
+    SDL_AtomicSet(&l_seeking, 1);
+    SDL_AtomicSet(&l_job, greenzone_job_seek);
+}
+
+int greenzone_is_seeking(void)
+{
+    return SDL_AtomicGet(&l_seeking);
+}
+
+int greenzone_is_replaying(void)
+{
+    /* VCR_GetCurFrame() is -1 without a movie */
+    return SDL_AtomicGet(&l_seeking)
+        && (greenzone_get_job() == greenzone_job_seek || VCR_GetCurFrame() < (unsigned int)SDL_AtomicGet(&l_seek_frame));
+}
+
+void greenzone_new_vi(void)
+{
+    unsigned int frame;
+    greenzone_job job = greenzone_get_job();
+    size_t i;
+
+    if (!VCR_IsPlaying())
+    {
+        SDL_AtomicSet(&l_seeking, 0);
+        return;
+    }
+
+    frame = VCR_GetCurFrame();
+    if (job != greenzone_job_seek && job != greenzone_job_restart
+     && frame >= (unsigned int)SDL_AtomicGet(&l_seek_frame) && SDL_AtomicCAS(&l_seeking, 1, 0))
+    {
+        DebugMessage(M64MSG_VERBOSE, "Movie seeked to frame %u", frame);
+    }
+
+    if (job != greenzone_job_nothing)
+        return;
+
+    if (SDL_AtomicGet(&l_reset) || (l_start_size == 0 && VCR_GetCurSample() == 0))
+    {
+        SDL_AtomicCAS(&l_job, greenzone_job_nothing, greenzone_job_capture);
+        return;
+    }
+
+    if (l_budget == 0)
+        return;
+
+    i = greenzone_upper_bound(frame);
+    if (i == 0 || frame - l_points[i - 1]->frame >= l_interval)
+        SDL_AtomicCAS(&l_job, greenzone_job_nothing, greenzone_job_capture);
+}
+
+greenzone_job greenzone_get_job(void)
+{
+    return (greenzone_job)SDL_AtomicGet(&l_job);
+}
+
+int greenzone_capture(void)
+{
+    struct greenzone_checkpoint *point;
+    struct greenzone_checkpoint *key = NULL;
+    unsigned int frame;
+    size_t size, words, length, i, k;
+
+    SDL_AtomicCAS(&l_job, greenzone_job_capture, greenzone_job_nothing);
+    greenzone_apply_requests();
+
+    if (!VCR_IsPlaying())
+        return 0;
+
+    if (l_start_size == 0 && VCR_GetCurSample() == 0)
+    {
+        l_start_size = savestates_save_to_buffer(&l_start, &l_start_capacity);
+        SDL_AtomicSet(&l_has_start, l_start_size != 0);
+    }
+
+    if (l_budget == 0)
+    {
+        greenzone_clear();
+        return l_start_size != 0;
+    }
+
+    frame = VCR_GetCurFrame();
+    i = greenzone_upper_bound(frame);
+    if (i > 0 && l_points[i - 1]->frame == frame)
+        return 1;
+
+    size = savestates_save_to_buffer(&l_state, &l_state_capacity);
+    if (size == 0)
+        return 0;
+
+    words = state_delta_words(size, size);
+    if (!state_delta_pad(&l_state, &l_state_capacity, size, words))
+    {
+        DebugMessage(M64MSG_WARNING, "Insufficient memory for movie checkpoint.");
+        return 0;
+    }
+
+    for (k = i; k > 0; --k)
+    {
+        if (l_points[k - 1]->key == NULL)
+        {
+            key = l_points[k - 1];
+            break;
+        }
+    }
+
+    length = 0;
+    if (key != NULL && words <= key->length)
+        length = state_delta_encode(NULL, key->data, (const uint32_t *)l_state, words);
+
+    /* a delta that is not much smaller than a key isn't worth depending on one */
+    if (key == NULL || words > key->length || length > words / 4)
+    {
+        key = NULL;
+        length = words + GREENZONE_KEY_SLACK / 4;
+
+        /* it would be dropped right away, and captured again on the next VI */
+        if (sizeof(*point) + length * sizeof(uint32_t) > l_budget)
+        {
+            DebugMessage(M64MSG_WARNING, "GreenzoneBufferSize is too small for a movie checkpoint (%u KB), greenzone disabled.",
+                         (unsigned int)(length * sizeof(uint32_t) / 1024));
+            l_budget = 0;
+            greenzone_clear();
+            return 1;
+        }
+    }
+
+    point = malloc(sizeof(*point) + length * sizeof(uint32_t));
+    if (point == NULL)
+    {
+        DebugMessage(M64MSG_WARNING, "Insufficient memory for movie checkpoint.");
+        return 0;
+    }
+
+    if (key != NULL)
+    {
+        state_delta_encode(point->data, key->data, (const uint32_t *)l_state, words);
+    }
+    else
+    {
+        memcpy(point->data, l_state, words * 4);
+        memset(point->data + words, 0, GREENZONE_KEY_SLACK);
+    }
+
+    point->frame = frame;
+    point->sample = VCR_GetCurSample();
+    point->key = key;
+    point->refs = 0;
+    point->state_size = size;
+    point->length = length;
+
+    if (!greenzone_insert(i, point))
+    {
+        free(point);
+        return 0;
+    }
+
+    greenzone_trim(frame);
+    return 1;
+}
+
+int greenzone_request_restart(void)
+{
+    if (SDL_AtomicGet(&l_reset) || !SDL_AtomicGet(&l_has_start))
+        return 0;
+
+    SDL_AtomicSet(&l_job, greenzone_job_restart);
+    return 1;
+}
+
+int greenzone_restore_start(void)
+{
+    SDL_AtomicCAS(&l_job, greenzone_job_restart, greenzone_job_nothing);
+
+    if (SDL_AtomicGet(&l_reset) || l_start_size == 0 || !VCR_IsPlaying())
+        return 0;
+
+    return savestates_load_from_buffer(l_start, l_start_size);
+}
+
+int greenzone_start_seek(void)
+{
+    unsigned int frame, seek_frame;
+    size_t i;
+
+    /* a seek requested from here on is handled next time */
+    SDL_AtomicCAS(&l_job, greenzone_job_seek, greenzone_job_nothing);
+    SDL_AtomicSet(&l_seeking, 1);
+    seek_frame = (unsigned int)SDL_AtomicGet(&l_seek_frame);
+    greenzone_apply_requests();
+
+    if (!VCR_IsPlaying())
+    {
+        SDL_AtomicSet(&l_seeking, 0);
+        return 0;
+    }
+
+    frame = VCR_GetCurFrame();
+    i = greenzone_upper_bound(seek_frame);
+
+    /* playing on is quicker when the current frame is the closest one before the target */
+    if (frame <= seek_frame && (i == 0 || l_points[i - 1]->frame <= frame))
+        return 0;
+
+    if (i == 0)
+    {
+        /* no checkpoint before the target, replay the movie from its start */
+        VCR_RestartMovie();
+        return 0;
+    }
+
+    if (!greenzone_restore(l_points[i - 1]))
+    {
+        SDL_AtomicSet(&l_seeking, 0);
+        return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,59 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - greenzone.h                                             *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __GREENZONE_H__
+#define __GREENZONE_H__
+
+typedef enum _greenzone_job
+{
+    greenzone_job_nothing,
+    greenzone_job_capture,
+    greenzone_job_seek,
+    greenzone_job_restart
+} greenzone_job;
+
+void greenzone_init(unsigned int interval, unsigned int buffer_size_mb);
+void greenzone_deinit(void);
+
+/* drops every checkpoint, for when another movie starts */
+void greenzone_reset(void);
+/* drops the checkpoints that depend on the movie samples from 'sample' on */
+void greenzone_invalidate(unsigned int sample);
+
+/* schedules a jump to 'frame' of the active movie */
+void greenzone_seek(unsigned int frame);
+/* nonzero from greenzone_seek until the frame is reached */
+int greenzone_is_seeking(void);
+/* nonzero while the frames before the seek target are replayed */
+int greenzone_is_replaying(void);
+
+/* schedules a return to the start state of the movie, returns 0 if it isn't known yet */
+int greenzone_request_restart(void);
+
+/* called on every VI, schedules a capture when the last checkpoint is 'interval' frames old */
+void greenzone_new_vi(void);
+
+greenzone_job greenzone_get_job(void);
+int greenzone_capture(void);
+int greenzone_restore_start(void);
+int greenzone_start_seek(void);
+
+#endif /* __GREENZONE_H__ */
@@ -0,0 +1,29 @@
+//st_delta.h
+//
+//Length rules of the compact .st movie data written by VCR_CollectSTDelta.
+//Cores that don't know about it tell a full copy of the inputs by its length alone,
+//so a compact block must never have the length of one.
+#ifndef ST_DELTA_H
+#define ST_DELTA_H
+#include <stddef.h>
+#include <stdint.h>
+
+#define ST_DELTA_MAGIC 0x4434364D //"M64D"
+
+//a full copy is the 4 header words followed by curSample+1 or lengthSamples+1 samples
+static inline int ST_IsFullCopy(size_t words, uint32_t curSample, uint32_t lengthSamples)
+{
+	return words == 5 + (size_t)curSample || words == 5 + (size_t)lengthSamples;
+}
+
+//4 header words, the magic, prefix, 2 hash words and the samples from prefix up to curSample,
+//padded until it can't pass for a full copy. The two full copy lengths can be adjacent.
+static inline size_t ST_DeltaWords(uint32_t prefix, uint32_t curSample, uint32_t lengthSamples)
+{
+	size_t words = 8 + (size_t)curSample + 1 - prefix;
+	while (ST_IsFullCopy(words, curSample, lengthSamples))
+		++words;
+	return words;
+}
+
+#endif
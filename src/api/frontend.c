@@ -46,6 +46,7 @@
 #include "main/workqueue.h"
 #include "main/screenshot.h"
 #include "main/netplay.h"
+#include "main/rewind.h"
 #include "plugin/plugin.h"
 #include "vidext.h"
 
@@ -317,6 +318,37 @@ EXPORT m64p_error CALL CoreDoCommand(m64p_command Command, int ParamInt, void *P
             if (ParamInt < 0 || ParamInt > 9)
                 return M64ERR_INPUT_INVALID;
             return main_core_state_set(M64CORE_SAVESTATE_SLOT, ParamInt);
+        case M64CMD_STATE_LOAD_MEM:
+            if (!g_EmulatorRunning)
+                return M64ERR_INVALID_STATE;
+            if (ParamInt < 0 || ParamInt >= SAVESTATES_MEM_SLOTS_COUNT)
+                return M64ERR_INPUT_INVALID;
+            main_state_load_mem(ParamInt);
+            return M64ERR_SUCCESS;
+        case M64CMD_STATE_SAVE_MEM:
+            if (!g_EmulatorRunning)
+                return M64ERR_INVALID_STATE;
+            if (ParamInt < 0 || ParamInt >= SAVESTATES_MEM_SLOTS_COUNT)
+                return M64ERR_INPUT_INVALID;
+            main_state_save_mem(ParamInt);
+            return M64ERR_SUCCESS;
+        case M64CMD_STATE_REWIND:
+            if (!g_EmulatorRunning)
+                return M64ERR_INVALID_STATE;
+            if (ParamInt < 0)
+                return M64ERR_INPUT_INVALID;
+            main_state_rewind(ParamInt);
+            return M64ERR_SUCCESS;
+        case M64CMD_SET_REWIND_BUFFER_SIZE:
+            /* before that, the size is read from the config when the emulation starts */
+            if (!g_EmulatorRunning)
+                return M64ERR_INVALID_STATE;
+            if (ParamInt < 0)
+                return M64ERR_INPUT_INVALID;
+            if (netplay_is_init())
+                return M64ERR_INVALID_STATE;
+            rewind_set_buffer_size(ParamInt);
+            return M64ERR_SUCCESS;
         case M64CMD_SEND_SDL_KEYDOWN:
             if (!g_EmulatorRunning)
                 return M64ERR_INVALID_STATE;
@@ -53,6 +53,32 @@ typedef enum {
   M64ENC_AUDIO,
 } m64p_encoder_hint_type;
 
+/* What happens when the encoder falls behind, set by the core's
+ * "EncoderBackpressure" parameter when an encode starts. */
+typedef enum {
+  /* The frame is dropped and the previous one repeated in its place, a
+   * dropped audio buffer is replaced by silence: the output keeps its timing
+   * but may stutter. */
+  M64ENC_DROP = 0,
+  /* Emulation waits for the encoder. Every frame is encoded, the output only
+   * depends on the emulation. */
+  M64ENC_BLOCK,
+  /* Frames are written to a temporary file next to the output and encoded
+   * from there once the encoder catches up. Audio waits as with M64ENC_BLOCK. */
+  M64ENC_SPILL,
+} m64p_encoder_backpressure;
+
+typedef struct {
+  unsigned int video_queued;   /* frames waiting in memory */
+  unsigned int video_spilled;  /* frames waiting in the spill file */
+  unsigned int audio_queued;   /* bytes of audio waiting */
+  uint64_t frames_encoded;     /* frames given to the encoder, repeats included */
+  uint64_t frames_dropped;     /* frames replaced by a repeat of the previous one */
+  uint64_t frames_spilled;     /* frames that went through the spill file */
+  uint64_t audio_dropped;      /* bytes of audio replaced by silence */
+  uint64_t stall_us;           /* time emulation waited for the encoder, in microseconds */
+} m64p_encoder_stats;
+
 /**
  * Returns 1 if the encoder is active, 0 otherwise.
  */
@@ -63,6 +89,17 @@ M64P_API_FN(bool, Encoder_IsActive);
  * - EncFFmpeg-Audio
  * - EncFFmpeg-Format
  * These sections correspond to the video codec, audio codec, and muxer respectively.
+ * Each parameter is passed on as an FFmpeg option; "codec" in the video or audio
+ * section names the encoder to use instead of the muxer's default one.
+ * format is an FFmpeg muxer name, or NULL to guess it from the path.
+ * The "y4m" format (or a .y4m path with a NULL format) instead dumps uncompressed
+ * video to path and 16-bit PCM audio to a .wav file next to it; it doesn't need
+ * FFmpeg and ignores the sections above. Likewise "wav" (or a .wav path) only
+ * writes the audio to a WAV file. FFmpeg muxers that only take audio, like
+ * "flac", also make audio-only captures. These never read the screen back from
+ * the video plugin, so they barely slow emulation down.
+ * Encoding runs on its own thread. What happens when it can't keep up is set
+ * by the core's "EncoderBackpressure" parameter, see m64p_encoder_backpressure.
  * If this function raises an error, no encode will be started.
  */
 M64P_API_FN(m64p_error, Encoder_Start, const char* path, const char* format);
@@ -70,12 +107,19 @@ M64P_API_FN(m64p_error, Encoder_Start, const char* path, const char* format);
  * Stops the encoder. If discard is true, discards data.
  */
 M64P_API_FN(m64p_error, Encoder_Stop, bool discard);
+/**
+ * Fills stats with the state of the current encode, or of the last one once it
+ * has stopped. Counters are reset by Encoder_Start.
+ */
+M64P_API_FN(m64p_error, Encoder_GetStats, m64p_encoder_stats* stats);
 
 // Audio callbacks
 
 /*
  * Registers a callback that will be called when new sample is available.
  * The called function receives pointer to the sample and size in bytes.
+ * While an encode is active, both callbacks are called from the encoder thread,
+ * in the order the samples and rate changes were produced.
  */
 M64P_API_FN(m64p_error, Encoder_SetSampleCallback, m64p_sample_callback* callback);
 M64P_API_FN(
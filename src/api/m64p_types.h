@@ -177,7 +177,11 @@ typedef enum {
   M64CMD_PIF_OPEN,
   M64CMD_ROM_SET_SETTINGS,
   M64CMD_DISK_OPEN,
-  M64CMD_DISK_CLOSE
+  M64CMD_DISK_CLOSE,
+  M64CMD_STATE_LOAD_MEM,
+  M64CMD_STATE_SAVE_MEM,
+  M64CMD_STATE_REWIND,
+  M64CMD_SET_REWIND_BUFFER_SIZE
 } m64p_command;
 
 typedef struct {
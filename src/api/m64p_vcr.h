@@ -156,6 +156,15 @@ EXPORT m64p_error CALL VCR_StartRecording(const char* path, const char* author,
 typedef m64p_error (*ptr_VCR_StartMovie)(const char* path);
 EXPORT m64p_error CALL VCR_StartMovie(const char* path);
 
+/// <summary>
+/// Jumps to a frame of the active movie. The closest earlier checkpoint kept in memory (see GreenzoneBufferSize)
+/// is restored and the frames left are replayed without drawing them. The movie is not truncated, even in read-write mode.
+/// </summary>
+/// <param name="frame">frame number, 0-indexed, up to the movie length</param>
+/// <returns>M64ERR_INVALID_STATE - no movie is playing, M64ERR_INPUT_INVALID - frame is past the movie end, otherwise M64ERR_SUCCESS</returns>
+typedef m64p_error (*ptr_VCR_SeekFrame)(unsigned frame);
+EXPORT m64p_error CALL VCR_SeekFrame(unsigned frame);
+
 #ifdef __cplusplus
 }
 #endif
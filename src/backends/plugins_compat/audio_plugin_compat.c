@@ -35,9 +35,8 @@
 
 static void audio_plugin_set_frequency(void* aout, unsigned int frequency) {
 #ifdef ENC_SUPPORT
-    if (Encoder_IsActive() && g_rate_changed_callback != NULL)
-        g_rate_changed_callback(frequency);
-        // encoder_set_sample_rate(frequency);
+    if (Encoder_IsActive())
+        encoder_set_sample_rate(frequency);
 #endif
 
     struct ai_controller* ai  = (struct ai_controller*) aout;
@@ -54,9 +53,8 @@ static void audio_plugin_push_samples(
     void* aout, const void* buffer, size_t size
 ) {
 #ifdef ENC_SUPPORT
-    if (Encoder_IsActive() && g_sample_callback != NULL)
-        g_sample_callback(buffer, size);
-        // encoder_push_audio(buffer, size);
+    if (Encoder_IsActive())
+        encoder_push_audio(buffer, size);
 #endif
     /* abuse core & audio plugin implementation to approximate desired effect */
     struct ai_controller* ai = (struct ai_controller*)aout;
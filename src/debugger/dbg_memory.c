@@ -139,13 +139,15 @@ void init_host_disassembler(void)
 static void decode_recompiled(struct r4300_core* r4300, uint32_t addr)
 {
     unsigned char *assemb, *end_addr;
+    const struct precomp_block* block;
 
     lines_recompiled=0;
 
-    if (r4300->cached_interp.blocks[addr>>12] == NULL)
+    block = cached_interp_get_block(&r4300->cached_interp, addr);
+    if (block == NULL)
         return;
 
-    if (r4300->cached_interp.blocks[addr>>12]->block[(addr&0xFFF)/4].ops == r4300->cached_interp.not_compiled)
+    if (block->block[(addr&0xFFF)/4].ops == r4300->cached_interp.not_compiled)
     {
         strcpy(opcode_recompiled[0],"INVLD");
         strcpy(args_recompiled[0],"NOTCOMPILED");
@@ -155,15 +157,15 @@ static void decode_recompiled(struct r4300_core* r4300, uint32_t addr)
         return;
     }
 
-    assemb = (r4300->cached_interp.blocks[addr>>12]->code) +
-        (r4300->cached_interp.blocks[addr>>12]->block[(addr&0xFFF)/4].local_addr);
+    assemb = (block->code) +
+        (block->block[(addr&0xFFF)/4].local_addr);
 
-    end_addr = r4300->cached_interp.blocks[addr>>12]->code;
+    end_addr = block->code;
 
     if ((addr & 0xFFF) >= 0xFFC)
-        end_addr += r4300->cached_interp.blocks[addr>>12]->code_length;
+        end_addr += block->code_length;
     else
-        end_addr += r4300->cached_interp.blocks[addr>>12]->block[(addr&0xFFF)/4+1].local_addr;
+        end_addr += block->block[(addr&0xFFF)/4+1].local_addr;
 
     while (assemb < end_addr)
     {
@@ -222,19 +224,21 @@ int get_num_recompiled(struct r4300_core* r4300, uint32_t addr)
 int get_has_recompiled(struct r4300_core* r4300, uint32_t addr)
 {
     unsigned char *assemb, *end_addr;
+    const struct precomp_block* block;
 
-    if (r4300->emumode != EMUMODE_DYNAREC || r4300->cached_interp.blocks[addr>>12] == NULL)
+    block = cached_interp_get_block(&r4300->cached_interp, addr);
+    if (r4300->emumode != EMUMODE_DYNAREC || block == NULL)
         return FALSE;
 
-    assemb = (r4300->cached_interp.blocks[addr>>12]->code) +
-        (r4300->cached_interp.blocks[addr>>12]->block[(addr&0xFFF)/4].local_addr);
+    assemb = (block->code) +
+        (block->block[(addr&0xFFF)/4].local_addr);
 
-    end_addr = r4300->cached_interp.blocks[addr>>12]->code;
+    end_addr = block->code;
 
     if ((addr & 0xFFF) >= 0xFFC)
-        end_addr += r4300->cached_interp.blocks[addr>>12]->code_length;
+        end_addr += block->code_length;
     else
-        end_addr += r4300->cached_interp.blocks[addr>>12]->block[(addr&0xFFF)/4+1].local_addr;
+        end_addr += block->block[(addr&0xFFF)/4+1].local_addr;
     if(assemb==end_addr)
         return FALSE;
 
@@ -34,6 +34,7 @@
 #include "api/m64p_types.h"
 #include "device/r4300/r4300_core.h"
 #include "device/r4300/idec.h"
+#include "device/rdram/rdram.h"
 #include "main/main.h"
 #include "osal/preproc.h"
 
@@ -66,6 +67,36 @@
 #endif
 #define DECLARE_INSTRUCTION(name) void cached_interp_##name(void)
 
+/* Jumps out of the block of inst. The instruction reached is remembered in
+ * inst, so that the next time the same address is jumped to, the lookup
+ * done by cached_interpreter_jump_to can be skipped. Only kseg0/kseg1
+ * targets are linked: their block can't change without their page being
+ * marked invalid (e.g. by invalidate_cached_code_hacktarux), which unlinks
+ * them until cached_interpreter_jump_to sets the page up again. */
+static void cached_interp_jump_linked(struct r4300_core* r4300, struct precomp_instr* inst, uint32_t address)
+{
+    struct cached_interp* const cinterp = &r4300->cached_interp;
+
+    if (inst->link != NULL
+     && inst->link->addr == address
+     && !cinterp->invalid_code[address >> 12]
+     && !cinterp->invalid_code[(address ^ UINT32_C(0x20000000)) >> 12])
+    {
+        cinterp->actual = inst->link_block;
+        (*r4300_pc_struct(r4300)) = inst->link;
+        return;
+    }
+
+    generic_jump_to(r4300, address);
+
+    if (r4300->emumode == EMUMODE_INTERPRETER
+     && (address & UINT32_C(0xc0000000)) == UINT32_C(0x80000000))
+    {
+        inst->link = *r4300_pc_struct(r4300);
+        inst->link_block = cinterp->actual;
+    }
+}
+
 #define DECLARE_JUMP(name, destination, condition, link, likely, cop1) \
 void cached_interp_##name(void) \
 { \
@@ -103,6 +134,7 @@ void cached_interp_##name(void) \
 void cached_interp_##name##_OUT(void) \
 { \
     DECLARE_R4300 \
+    struct precomp_instr* const inst = *r4300_pc_struct(r4300); \
     const int take_jump = (condition); \
     const uint32_t jump_target = (destination); \
     int64_t *link_register = (link); \
@@ -121,7 +153,7 @@ void cached_interp_##name##_OUT(void) \
         r4300->delay_slot=0; \
         if (take_jump && !r4300->skip_jump) \
         { \
-            generic_jump_to(r4300, jump_target); \
+            cached_interp_jump_linked(r4300, inst, jump_target); \
         } \
     } \
     else \
@@ -196,7 +228,7 @@ void cached_interp_FIN_BLOCK(void)
     DECLARE_R4300
     if (!r4300->delay_slot)
     {
-        generic_jump_to(r4300, ((*r4300_pc_struct(r4300))-1)->addr+4);
+        cached_interp_jump_linked(r4300, *r4300_pc_struct(r4300), ((*r4300_pc_struct(r4300))-1)->addr+4);
 /*
 #ifdef DBG
       if (g_DebuggerActive) update_debugger(*r4300_pc(r4300));
@@ -231,7 +263,8 @@ Used by dynarec only, check should be unnecessary
 void cached_interp_NOTCOMPILED(void)
 {
     DECLARE_R4300
-    uint32_t *mem = fast_mem_access(r4300, r4300->cached_interp.blocks[*r4300_pc(r4300)>>12]->start);
+    struct precomp_block* block = cached_interp_get_block(&r4300->cached_interp, *r4300_pc(r4300));
+    uint32_t *mem = fast_mem_access(r4300, block->start);
 #ifdef DBG
     DebugMessage(M64MSG_INFO, "NOTCOMPILED: addr = %x ops = %lx", *r4300_pc(r4300), (long) (*r4300_pc_struct(r4300))->ops);
 #endif
@@ -240,7 +273,7 @@ void cached_interp_NOTCOMPILED(void)
         DebugMessage(M64MSG_ERROR, "not compiled exception");
     }
     else {
-        r4300->cached_interp.recompile_block(r4300, mem, r4300->cached_interp.blocks[*r4300_pc(r4300) >> 12], *r4300_pc(r4300));
+        r4300->cached_interp.recompile_block(r4300, mem, block, *r4300_pc(r4300));
     }
 
 /*
@@ -366,6 +399,8 @@ enum r4300_opcode r4300_decode(struct precomp_instr* inst, struct r4300_core* r4
     uint8_t dummy;
     enum r4300_opcode opcode = idec->opcode;
 
+    inst->link = NULL;
+
     switch(idec->opcode)
     {
     case R4300_OP_JALR:
@@ -751,7 +786,12 @@ void cached_interp_init_block(struct r4300_core* r4300, uint32_t address)
 {
     int i, length;
 
-    struct precomp_block** block = &r4300->cached_interp.blocks[address >> 12];
+    struct precomp_block** block = cached_interp_block_slot(&r4300->cached_interp, address);
+
+    if (block == NULL) {
+        DebugMessage(M64MSG_ERROR, "Memory error: couldn't allocate block table for cached interpreter.");
+        return;
+    }
 
     /* allocate block */
     if (*block == NULL) {
@@ -853,8 +893,9 @@ void cached_interp_recompile_block(struct r4300_core* r4300, const uint32_t* iw,
         if (block_start_in_tlb)
         {
             uint32_t address2 = virtual_to_physical_address(r4300, inst->addr, 0);
-            if (r4300->cached_interp.blocks[address2>>12]->block[(address2&UINT32_C(0xFFF))/4].ops == cached_interp_NOTCOMPILED) {
-                r4300->cached_interp.blocks[address2>>12]->block[(address2&UINT32_C(0xFFF))/4].ops = cached_interp_NOTCOMPILED2;
+            struct precomp_instr* inst2 = &cached_interp_get_block(&r4300->cached_interp, address2)->block[(address2&UINT32_C(0xFFF))/4];
+            if (inst2->ops == cached_interp_NOTCOMPILED) {
+                inst2->ops = cached_interp_NOTCOMPILED2;
             }
         }
 
@@ -914,35 +955,54 @@ void cached_interpreter_jump_to(struct r4300_core* r4300, uint32_t address)
     }
 
     /* set new PC */
-    cinterp->actual = cinterp->blocks[address >> 12];
+    cinterp->actual = cached_interp_get_block(cinterp, address);
     (*r4300_pc_struct(r4300)) = cinterp->actual->block + ((address - cinterp->actual->start) >> 2);
 }
 
 
 void init_blocks(struct cached_interp* cinterp)
 {
-    size_t i;
-    for (i = 0; i < 0x100000; ++i)
-    {
-        cinterp->invalid_code[i] = 1;
-        cinterp->blocks[i] = NULL;
-    }
+    memset(cinterp->invalid_code, 1, 0x100000);
+    memset(cinterp->blocks, 0, sizeof(cinterp->blocks));
 }
 
 void free_blocks(struct cached_interp* cinterp)
 {
-    size_t i;
-    for (i = 0; i < 0x100000; ++i)
+    size_t i, j;
+    for (i = 0; i < CACHED_INTERP_BLOCK_DIR_SIZE; ++i)
     {
-        if (cinterp->blocks[i])
+        struct precomp_block** table = cinterp->blocks[i];
+
+        if (table == NULL)
+            continue;
+
+        for (j = 0; j < CACHED_INTERP_BLOCK_TABLE_SIZE; ++j)
         {
-            cinterp->free_block(cinterp->blocks[i]);
-            free(cinterp->blocks[i]);
-            cinterp->blocks[i] = NULL;
+            if (table[j])
+            {
+                cinterp->free_block(table[j]);
+                free(table[j]);
+            }
         }
+
+        free(table);
+        cinterp->blocks[i] = NULL;
     }
 }
 
+struct precomp_block** cached_interp_block_slot(struct cached_interp* cinterp, uint32_t address)
+{
+    struct precomp_block*** table = &cinterp->blocks[address >> (12 + CACHED_INTERP_BLOCK_TABLE_BITS)];
+
+    if (*table == NULL) {
+        *table = calloc(CACHED_INTERP_BLOCK_TABLE_SIZE, sizeof(**table));
+        if (*table == NULL)
+            return NULL;
+    }
+
+    return &(*table)[(address >> 12) & (CACHED_INTERP_BLOCK_TABLE_SIZE - 1)];
+}
+
 void invalidate_cached_code_hacktarux(struct r4300_core* r4300, uint32_t address, size_t size)
 {
     size_t i;
@@ -965,8 +1025,10 @@ void invalidate_cached_code_hacktarux(struct r4300_core* r4300, uint32_t address
 
             if (r4300->cached_interp.invalid_code[i] == 0)
             {
-                if (r4300->cached_interp.blocks[i] == NULL
-                 || r4300->cached_interp.blocks[i]->block[(addr & 0xfff) / 4].ops != r4300->cached_interp.not_compiled)
+                const struct precomp_block* block = cached_interp_get_block(&r4300->cached_interp, addr);
+
+                if (block == NULL
+                 || block->block[(addr & 0xfff) / 4].ops != r4300->cached_interp.not_compiled)
                 {
                     r4300->cached_interp.invalid_code[i] = 1;
                     /* go directly to next i */
@@ -984,6 +1046,48 @@ void invalidate_cached_code_hacktarux(struct r4300_core* r4300, uint32_t address
     }
 }
 
+void invalidate_non_rdram_code_hacktarux(struct r4300_core* r4300)
+{
+    size_t i;
+    char* invalid_code = r4300->cached_interp.invalid_code;
+
+    /* only kseg0/kseg1 pages map to RDRAM without going through the TLB,
+     * which can change with the loaded state */
+    for (i = 0; i < 0x100000; ++i)
+    {
+        if ((i & 0xc0000) != 0x80000
+         || ((uint32_t)(i << 12) & UINT32_C(0x1fffffff)) >= r4300->rdram->dram_size)
+        {
+            invalid_code[i] = 1;
+        }
+    }
+}
+
+void invalidate_changed_code_hacktarux(struct r4300_core* r4300, uint32_t address, const uint32_t* new_dram, size_t size)
+{
+    uint32_t paddr;
+    uint32_t offset;
+    char* invalid_code = r4300->cached_interp.invalid_code;
+
+    for (offset = 0; offset < size; offset += 0x1000)
+    {
+        paddr = address + offset;
+        if (paddr >= r4300->rdram->dram_size)
+            break;
+
+        if (invalid_code[(UINT32_C(0x80000000) + paddr) >> 12]
+         && invalid_code[(UINT32_C(0xa0000000) + paddr) >> 12])
+            continue;
+
+        if (size - offset < 0x1000
+         || memcmp(r4300->rdram->dram + paddr / 4, new_dram + offset / 4, 0x1000) != 0)
+        {
+            invalid_code[(UINT32_C(0x80000000) + paddr) >> 12] = 1;
+            invalid_code[(UINT32_C(0xa0000000) + paddr) >> 12] = 1;
+        }
+    }
+}
+
 void run_cached_interpreter(struct r4300_core* r4300)
 {
     while (!*r4300_stop(r4300))
@@ -46,8 +46,19 @@ void cached_interp_recompile_block(struct r4300_core* r4300, const uint32_t* iw,
 void init_blocks(struct cached_interp* cinterp);
 void free_blocks(struct cached_interp* cinterp);
 
+/* Returns where the block of the page containing address is stored,
+ * allocating its table if needed. Returns NULL on allocation failure. */
+struct precomp_block** cached_interp_block_slot(struct cached_interp* cinterp, uint32_t address);
+
 void invalidate_cached_code_hacktarux(struct r4300_core* r4300, uint32_t address, size_t size);
 
+/* Invalidate code compiled from pages outside of RDRAM or mapped through the TLB. */
+void invalidate_non_rdram_code_hacktarux(struct r4300_core* r4300);
+
+/* Invalidate code compiled from RDRAM pages in [address, address+size)
+ * whose content differs in new_dram. */
+void invalidate_changed_code_hacktarux(struct r4300_core* r4300, uint32_t address, const uint32_t* new_dram, size_t size);
+
 void run_cached_interpreter(struct r4300_core* r4300);
 
 /* Jumps to the given address. This is for the cached interpreter. */
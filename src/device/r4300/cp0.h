@@ -142,6 +142,9 @@ enum r4300_cp0_registers
 
 enum { INTERRUPT_NODES_POOL_CAPACITY = 16 };
 
+/* number of known event types (see interrupt.h), each has a lookup slot */
+enum { INTERRUPT_EVENT_SLOTS = 15 };
+
 struct interrupt_event
 {
     int type;
@@ -152,6 +155,7 @@ struct node
 {
     struct interrupt_event data;
     struct node *next;
+    struct node *prev;
 };
 
 struct pool
@@ -165,6 +169,9 @@ struct interrupt_queue
 {
     struct pool pool;
     struct node* first;
+    /* first event of each known type in queue order, and how many are queued */
+    struct node* by_type[INTERRUPT_EVENT_SLOTS];
+    unsigned char type_count[INTERRUPT_EVENT_SLOTS];
 };
 
 struct interrupt_handler
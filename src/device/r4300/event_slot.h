@@ -0,0 +1,65 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - event_slot.h                                             *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_DEVICE_R4300_EVENT_SLOT_H
+#define M64P_DEVICE_R4300_EVENT_SLOT_H
+
+#include <stdint.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "device/r4300/interrupt.h"
+#include "osal/preproc.h"
+
+/* Number of the lowest set bit, bit must not be 0. */
+static osal_inline int lowest_bit(uint32_t bit)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, bit);
+    return (int)index;
+#elif defined(__GNUC__)
+    return __builtin_ctz(bit);
+#else
+    int index = 0;
+    while ((bit & 1) == 0) {
+        bit >>= 1;
+        ++index;
+    }
+    return index;
+#endif
+}
+
+/* Slot of a known event type, -1 for anything else (e.g. from a bad savestate).
+ * Types are single bits, the slot is the bit number. */
+static osal_inline int event_slot(int type)
+{
+    uint32_t bit = (uint32_t)type;
+
+    if (bit == 0 || (bit & (bit - 1)) != 0 || bit > DD_DV_INT) {
+        return -1;
+    }
+
+    return lowest_bit(bit);
+}
+
+#endif /* M64P_DEVICE_R4300_EVENT_SLOT_H */
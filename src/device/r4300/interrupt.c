@@ -38,17 +38,22 @@
 #include "device/pif/bootrom_hle.h"
 #include "device/r4300/cached_interp.h"
 #include "device/r4300/cp0.h"
+#include "device/r4300/event_slot.h"
 #include "device/r4300/new_dynarec/new_dynarec.h"
 #include "device/r4300/r4300_core.h"
 #include "device/r4300/recomp.h"
 #include "device/rcp/ai/ai_controller.h"
 #include "device/rcp/vi/vi_controller.h"
 #include "main/main.h"
+#include "main/rewind.h"
 #include "main/savestates.h"
+#ifdef VCR_SUPPORT
+#include "VCR/greenzone.h"
+#endif
 
 
 /***************************************************************************
- * Pool of Single Linked List Nodes
+ * Pool of Queue Nodes
  **************************************************************************/
 
 static struct node* alloc_node(struct pool* p);
@@ -92,24 +97,96 @@ static void clear_pool(struct pool* p)
  * Interrupt Queue
  **************************************************************************/
 
+/* The queue is a doubly linked list in the order events fire. Events are
+ * placed when they are added and never reordered, which keeps the order
+ * savestates and movies depend on. Each known type also has a slot pointing
+ * to its first event, so that looking up or removing an event by type
+ * doesn't walk the list. */
+
 static void clear_queue(struct interrupt_queue* q)
 {
     q->first = NULL;
+    memset(q->by_type, 0, sizeof(q->by_type));
+    memset(q->type_count, 0, sizeof(q->type_count));
     clear_pool(&q->pool);
 }
 
-static int before_event(const struct cp0* cp0, unsigned int evt1, unsigned int evt2, int type2)
+static struct node* find_event(struct node* e, int type)
+{
+    for (; e != NULL && e->data.type != type; e = e->next);
+    return e;
+}
+
+static struct node* lookup_event(const struct interrupt_queue* q, int type)
+{
+    int slot = event_slot(type);
+
+    return (slot >= 0)
+        ? q->by_type[slot]
+        : find_event(q->first, type);
+}
+
+/* links event after prev, or at the front if prev is NULL */
+static void insert_event(struct interrupt_queue* q, struct node* prev, struct node* event)
+{
+    int slot = event_slot(event->data.type);
+
+    event->prev = prev;
+    event->next = (prev != NULL) ? prev->next : q->first;
+    if (event->next != NULL) {
+        event->next->prev = event;
+    }
+    if (prev != NULL) {
+        prev->next = event;
+    }
+    else {
+        q->first = event;
+    }
+
+    if (slot >= 0) {
+        /* with several events of a type, the new one may come first */
+        q->by_type[slot] = (q->type_count[slot]++ == 0)
+            ? event
+            : find_event(q->first, event->data.type);
+    }
+}
+
+static void unlink_event(struct interrupt_queue* q, struct node* event)
 {
-    const uint32_t* cp0_regs = r4300_cp0_regs((struct cp0*)cp0); /* OK to cast away const qualifier */
-    uint32_t count = cp0_regs[CP0_COUNT_REG];
-    int* cp0_cycle_count = r4300_cp0_cycle_count((struct cp0*)cp0);
+    int slot = event_slot(event->data.type);
+
+    if (event->prev != NULL) {
+        event->prev->next = event->next;
+    }
+    else {
+        q->first = event->next;
+    }
+    if (event->next != NULL) {
+        event->next->prev = event->prev;
+    }
+
+    if (slot >= 0) {
+        --q->type_count[slot];
+        if (q->by_type[slot] == event) {
+            q->by_type[slot] = (q->type_count[slot] > 0)
+                ? find_event(event->next, event->data.type)
+                : NULL;
+        }
+    }
 
+    free_node(&q->pool, event);
+}
+
+/* Events are ordered by their distance from this point, so that the order
+ * survives the count register wrapping around. It is the current count, or
+ * the first event when it is overdue. */
+static uint32_t queue_base(uint32_t count, int cycle_count)
+{
     /* At least one other interrupt is pending */
-    if (*cp0_cycle_count > 0)
-        count -= *cp0_cycle_count;
+    if (cycle_count > 0)
+        count -= cycle_count;
 
-    if ((evt1 - count) < (evt2 - count)) return 1;
-    else return 0;
+    return count;
 }
 
 unsigned int add_random_interrupt_time(struct r4300_core* r4300)
@@ -136,11 +213,12 @@ void add_interrupt_event_count(struct cp0* cp0, int type, unsigned int count)
 {
     struct node* event;
     struct node* e;
+    uint32_t base;
     const uint32_t* cp0_regs = r4300_cp0_regs(cp0);
     unsigned int* cp0_next_interrupt = r4300_cp0_next_interrupt(cp0);
     int* cp0_cycle_count = r4300_cp0_cycle_count(cp0);
 
-    if (get_event(&cp0->q, type)) {
+    if (lookup_event(&cp0->q, type)) {
         DebugMessage(M64MSG_WARNING, "two events of type 0x%x in interrupt queue", type);
     }
 
@@ -154,35 +232,19 @@ void add_interrupt_event_count(struct cp0* cp0, int type, unsigned int count)
     event->data.count = count;
     event->data.type = type;
 
-    if (cp0->q.first == NULL)
+    /* goes after the events due before or at the same time */
+    base = queue_base(cp0_regs[CP0_COUNT_REG], *cp0_cycle_count);
+    if (cp0->q.first == NULL || (count - base) < (cp0->q.first->data.count - base))
     {
-        cp0->q.first = event;
-        event->next = NULL;
-    }
-    else if (before_event(cp0, count, cp0->q.first->data.count, cp0->q.first->data.type))
-    {
-        event->next = cp0->q.first;
-        cp0->q.first = event;
+        insert_event(&cp0->q, NULL, event);
     }
     else
     {
         for (e = cp0->q.first;
-            e->next != NULL &&
-            (!before_event(cp0, count, e->next->data.count, e->next->data.type));
+            e->next != NULL && (e->next->data.count - base) <= (count - base);
             e = e->next);
 
-        if (e->next == NULL)
-        {
-            e->next = event;
-            event->next = NULL;
-        }
-        else
-        {
-            for(; e->next != NULL && e->next->data.count == count; e = e->next);
-
-            event->next = e->next;
-            e->next = event;
-        }
+        insert_event(&cp0->q, e, event);
     }
     *cp0_next_interrupt = cp0->q.first->data.count;
     *cp0_cycle_count = cp0_regs[CP0_COUNT_REG] - cp0->q.first->data.count;
@@ -190,14 +252,11 @@ void add_interrupt_event_count(struct cp0* cp0, int type, unsigned int count)
 
 void remove_interrupt_event(struct cp0* cp0)
 {
-    struct node* e;
     const uint32_t* cp0_regs = r4300_cp0_regs(cp0);
     unsigned int* cp0_next_interrupt = r4300_cp0_next_interrupt(cp0);
     int* cp0_cycle_count = r4300_cp0_cycle_count(cp0);
 
-    e = cp0->q.first;
-    cp0->q.first = e->next;
-    free_node(&cp0->q.pool, e);
+    unlink_event(&cp0->q, cp0->q.first);
 
     *cp0_next_interrupt = (cp0->q.first != NULL)
         ? cp0->q.first->data.count
@@ -210,20 +269,10 @@ void remove_interrupt_event(struct cp0* cp0)
 
 unsigned int* get_event(const struct interrupt_queue* q, int type)
 {
-    struct node* e = q->first;
+    struct node* e = lookup_event(q, type);
 
-    if (e == NULL) {
-        return NULL;
-    }
-
-    if (e->data.type == type) {
-        return &e->data.count;
-    }
-
-    for (; e->next != NULL && e->next->data.type != type; e = e->next);
-
-    return (e->next != NULL)
-        ? &e->next->data.count
+    return (e != NULL)
+        ? &e->data.count
         : NULL;
 }
 
@@ -236,28 +285,10 @@ int get_next_event_type(const struct interrupt_queue* q)
 
 void remove_event(struct interrupt_queue* q, int type)
 {
-    struct node* to_del;
-    struct node* e = q->first;
-
-    if (e == NULL) {
-        return;
-    }
-
-    if (e->data.type == type)
-    {
-        q->first = e->next;
-        free_node(&q->pool, e);
-    }
-    else
-    {
-        for (; e->next != NULL && e->next->data.type != type; e = e->next);
+    struct node* e = lookup_event(q, type);
 
-        if (e->next != NULL)
-        {
-            to_del = e->next;
-            e->next = to_del->next;
-            free_node(&q->pool, to_del);
-        }
+    if (e != NULL) {
+        unlink_event(q, e);
     }
 }
 
@@ -363,17 +394,7 @@ void r4300_check_interrupt(struct r4300_core* r4300, uint32_t cause_ip, int set_
         event->data.type = CHECK_INT;
         *cp0_cycle_count = 0;
 
-        if (r4300->cp0.q.first == NULL)
-        {
-            r4300->cp0.q.first = event;
-            event->next = NULL;
-        }
-        else
-        {
-            event->next = r4300->cp0.q.first;
-            r4300->cp0.q.first = event;
-
-        }
+        insert_event(&r4300->cp0.q, NULL, event);
     }
 }
 
@@ -556,6 +577,24 @@ void gen_interrupt(struct r4300_core* r4300)
             return;
         }
 
+        if (rewind_get_job() == rewind_job_restore)
+        {
+            rewind_restore();
+            return;
+        }
+
+#ifdef VCR_SUPPORT
+        if (greenzone_get_job() == greenzone_job_restart)
+        {
+            greenzone_restore_start();
+            return;
+        }
+
+        /* only returns when a checkpoint was restored, otherwise the movie plays on to the target */
+        if (greenzone_get_job() == greenzone_job_seek && greenzone_start_seek())
+            return;
+#endif
+
         if (r4300->reset_hard_job)
         {
             call_interrupt_handler(&r4300->cp0, 11);
@@ -670,6 +709,22 @@ void gen_interrupt(struct r4300_core* r4300)
             savestates_save();
             return;
         }
+
+        if (rewind_get_job() == rewind_job_capture)
+        {
+            rewind_capture();
+            return;
+        }
+
+#ifdef VCR_SUPPORT
+        /* the start state of a movie must come after the load or reset it starts with */
+        if (greenzone_get_job() == greenzone_job_capture &&
+            savestates_get_job() != savestates_job_load && !r4300->reset_hard_job)
+        {
+            greenzone_capture();
+            return;
+        }
+#endif
     }
 }
 
@@ -41,7 +41,7 @@
 #include <time.h>
 
 void init_r4300(struct r4300_core* r4300, struct memory* mem, struct mi_controller* mi, struct rdram* rdram, const struct interrupt_handler* interrupt_handlers,
-    unsigned int emumode, unsigned int count_per_op, unsigned int count_per_op_denom_pot, int no_compiled_jump, int randomize_interrupt, uint32_t start_address)
+    unsigned int emumode, unsigned int count_per_op, unsigned int count_per_op_denom_pot, int no_compiled_jump, unsigned int tier_threshold, int randomize_interrupt, uint32_t start_address)
 {
     struct new_dynarec_hot_state* new_dynarec_hot_state =
 #ifdef NEW_DYNAREC
@@ -57,6 +57,7 @@ void init_r4300(struct r4300_core* r4300, struct memory* mem, struct mi_controll
 
 #ifndef NEW_DYNAREC
     r4300->recomp.no_compiled_jump = no_compiled_jump;
+    r4300->recomp.tier_threshold = tier_threshold;
 #endif
 
     r4300->mem = mem;
@@ -151,6 +152,13 @@ void run_r4300(struct r4300_core* r4300)
     else if (r4300->emumode >= 2)
     {
         DebugMessage(M64MSG_INFO, "Starting R4300 emulator: Dynamic Recompiler");
+#ifndef NEW_DYNAREC
+        r4300->recomp.tiered = (r4300->emumode == EMUMODE_TIERED);
+        r4300->recomp.cold_interp = 0;
+        if (r4300->recomp.tiered) {
+            DebugMessage(M64MSG_INFO, "Interpreting code until it gets hot");
+        }
+#endif
         r4300->emumode = EMUMODE_DYNAREC;
         init_blocks(&r4300->cached_interp);
 #ifdef NEW_DYNAREC
@@ -422,6 +430,37 @@ void invalidate_r4300_cached_code(struct r4300_core* r4300, uint32_t address, si
     }
 }
 
+void invalidate_r4300_non_rdram_code(struct r4300_core* r4300)
+{
+    if (r4300->emumode != EMUMODE_PURE_INTERPRETER)
+    {
+#ifdef NEW_DYNAREC
+        if (r4300->emumode == EMUMODE_DYNAREC)
+        {
+            /* the new dynarec doesn't track pages this way, drop all of its code */
+            invalidate_cached_code_new_dynarec(r4300, 0, 0);
+        }
+        else
+#endif
+        {
+            invalidate_non_rdram_code_hacktarux(r4300);
+        }
+    }
+}
+
+void invalidate_r4300_changed_code(struct r4300_core* r4300, uint32_t address, const uint32_t* new_dram, size_t size)
+{
+#ifdef NEW_DYNAREC
+    /* all of its code is already gone, see invalidate_r4300_non_rdram_code */
+    if (r4300->emumode == EMUMODE_DYNAREC)
+        return;
+#endif
+    if (r4300->emumode != EMUMODE_PURE_INTERPRETER)
+    {
+        invalidate_changed_code_hacktarux(r4300, address, new_dram, size);
+    }
+}
+
 
 void generic_jump_to(struct r4300_core* r4300, uint32_t address)
 {
@@ -457,5 +496,4 @@ void generic_jump_to(struct r4300_core* r4300, uint32_t address)
 void savestates_load_set_pc(struct r4300_core* r4300, uint32_t pc)
 {
     generic_jump_to(r4300, pc);
-    invalidate_r4300_cached_code(r4300, 0, 0);
 }
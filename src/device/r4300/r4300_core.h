@@ -44,10 +44,19 @@ struct mi_controller;
 struct rdram;
 
 struct jump_table;
+
+/* Blocks of 4KB pages are looked up through a two-level table: a directory
+ * indexed by the top bits of the address points to tables covering
+ * CACHED_INTERP_BLOCK_TABLE_SIZE pages each, which are only allocated once
+ * a block is created inside them. */
+#define CACHED_INTERP_BLOCK_TABLE_BITS 12
+#define CACHED_INTERP_BLOCK_TABLE_SIZE (1 << CACHED_INTERP_BLOCK_TABLE_BITS)
+#define CACHED_INTERP_BLOCK_DIR_SIZE (0x100000 >> CACHED_INTERP_BLOCK_TABLE_BITS)
+
 struct cached_interp
 {
     char invalid_code[0x100000];
-    struct precomp_block* blocks[0x100000];
+    struct precomp_block** blocks[CACHED_INTERP_BLOCK_DIR_SIZE];
     struct precomp_block* actual;
 
     void (*fin_block)(void);
@@ -61,10 +70,22 @@ struct cached_interp
         const uint32_t* source, struct precomp_block* block, uint32_t func);
 };
 
+/* Returns the block of the page containing address, or NULL if there is none. */
+static osal_inline struct precomp_block* cached_interp_get_block(const struct cached_interp* cinterp, uint32_t address)
+{
+    struct precomp_block** table = cinterp->blocks[address >> (12 + CACHED_INTERP_BLOCK_TABLE_BITS)];
+
+    return (table != NULL)
+        ? table[(address >> 12) & (CACHED_INTERP_BLOCK_TABLE_SIZE - 1)]
+        : NULL;
+}
+
 enum {
     EMUMODE_PURE_INTERPRETER = 0,
     EMUMODE_INTERPRETER      = 1,
     EMUMODE_DYNAREC          = 2,
+    /* dynarec interpreting code until it gets hot, runs as EMUMODE_DYNAREC */
+    EMUMODE_TIERED           = 3,
 };
 
 
@@ -159,6 +180,9 @@ struct r4300_core
         uint32_t jump_to_address;
         int64_t local_rs;
         unsigned int dyna_interp;
+        int tiered;                                     /* interpret cold code, see dynarec_notcompiled */
+        unsigned int tier_threshold;                    /* instructions of a page interpreted before it gets recompiled */
+        int cold_interp;                                /* interpreting cold code */
 
 #if defined(__x86_64__)
         unsigned long long shift;
@@ -214,7 +238,7 @@ struct r4300_core
     offsetof(struct new_dynarec_hot_state, regs))
 #endif
 
-void init_r4300(struct r4300_core* r4300, struct memory* mem, struct mi_controller* mi, struct rdram* rdram, const struct interrupt_handler* interrupt_handlers, unsigned int emumode, unsigned int count_per_op, unsigned int count_per_op_denom_pot, int no_compiled_jump, int randomize_interrupt, uint32_t start_address);
+void init_r4300(struct r4300_core* r4300, struct memory* mem, struct mi_controller* mi, struct rdram* rdram, const struct interrupt_handler* interrupt_handlers, unsigned int emumode, unsigned int count_per_op, unsigned int count_per_op_denom_pot, int no_compiled_jump, unsigned int tier_threshold, int randomize_interrupt, uint32_t start_address);
 void poweron_r4300(struct r4300_core* r4300);
 
 void run_r4300(struct r4300_core* r4300);
@@ -247,6 +271,18 @@ int r4300_write_aligned_dword(struct r4300_core* r4300, uint32_t address, uint64
  */
 void invalidate_r4300_cached_code(struct r4300_core* r4300, uint32_t address, size_t size);
 
+/* Allow cached/dynarec r4300 implementations to keep their cached code
+ * across a savestate load. A load first calls invalidate_r4300_non_rdram_code,
+ * which invalidates code that doesn't come from RDRAM or is mapped through
+ * the TLB. Then for RDRAM, code compiled from pages in [address, address+size)
+ * whose content is identical in new_dram can be kept, everything else is
+ * invalidated. address must be page aligned.
+ *
+ * Must be called before RDRAM is overwritten with new_dram.
+ */
+void invalidate_r4300_non_rdram_code(struct r4300_core* r4300);
+void invalidate_r4300_changed_code(struct r4300_core* r4300, uint32_t address, const uint32_t* new_dram, size_t size);
+
 /* Jump to the given address. This works for all r4300 emulator, but is slower.
  * Use this for common code which can be executed from any r4300 emulator. */
 void generic_jump_to(struct r4300_core* r4300, unsigned int address);
@@ -459,7 +459,12 @@ void dynarec_init_block(struct r4300_core* r4300, uint32_t address)
     timed_section_start(TIMED_SECTION_COMPILER);
 #endif
 
-    struct precomp_block** block = &r4300->cached_interp.blocks[address >> 12];
+    struct precomp_block** block = cached_interp_block_slot(&r4300->cached_interp, address);
+
+    if (block == NULL) {
+        DebugMessage(M64MSG_ERROR, "Memory error: couldn't allocate block table for dynarec.");
+        return;
+    }
 
     /* allocate block */
     if (*block == NULL) {
@@ -475,6 +480,8 @@ void dynarec_init_block(struct r4300_core* r4300, uint32_t address)
     struct precomp_block* b = *block;
 
     length = get_block_length(b);
+    /* (re)initialized code starts cold again */
+    b->heat = 0;
 
 #ifdef DBG
     DebugMessage(M64MSG_INFO, "init block %" PRIX32 " - %" PRIX32, b->start, b->end);
@@ -660,8 +667,9 @@ void dynarec_recompile_block(struct r4300_core* r4300, const uint32_t* iw, struc
         if (block_start_in_tlb)
         {
             uint32_t address2 = virtual_to_physical_address(r4300, r4300->recomp.dst->addr, 0);
-            if (r4300->cached_interp.blocks[address2>>12]->block[(address2&UINT32_C(0xFFF))/4].ops == r4300->cached_interp.not_compiled) {
-                r4300->cached_interp.blocks[address2>>12]->block[(address2&UINT32_C(0xFFF))/4].ops = r4300->cached_interp.not_compiled2;
+            struct precomp_instr* inst2 = &cached_interp_get_block(&r4300->cached_interp, address2)->block[(address2&UINT32_C(0xFFF))/4];
+            if (inst2->ops == r4300->cached_interp.not_compiled) {
+                inst2->ops = r4300->cached_interp.not_compiled2;
             }
         }
 
@@ -846,13 +854,15 @@ void profile_write_end_of_code_blocks(struct r4300_core* r4300)
     r4300->recomp.pfProfile = osal_file_open("instructionaddrs.dat", "ab");
 
     for (i = 0; i < 0x100000; ++i) {
-        if (r4300->cached_interp.invalid_code[i] == 0 && r4300->cached_interp.blocks[i] != NULL && r4300->cached_interp.blocks[i]->code != NULL && r4300->cached_interp.blocks[i]->block != NULL)
+        const struct precomp_block* block = cached_interp_get_block(&r4300->cached_interp, (uint32_t)(i << 12));
+
+        if (r4300->cached_interp.invalid_code[i] == 0 && block != NULL && block->code != NULL && block->block != NULL)
         {
             unsigned char *x86addr;
             int mipsop;
             // store final code length for this block
             mipsop = -1; /* -1 == end of x86 code block */
-            x86addr = r4300->cached_interp.blocks[i]->code + r4300->cached_interp.blocks[i]->code_length;
+            x86addr = block->code + block->code_length;
             if (fwrite(&mipsop, 1, 4, r4300->recomp.pfProfile) != 4 ||
                     fwrite(&x86addr, 1, sizeof(char *), r4300->recomp.pfProfile) != sizeof(char *))
                 DebugMessage(M64MSG_ERROR, "Error writing R4300 instruction address profiling data");
@@ -877,9 +887,66 @@ void dynarec_fin_block(void)
     dyna_jump();
 }
 
+/* In tiered mode, runs the cached interpreter from an instruction which
+ * isn't recompiled yet, until the page of the current instruction has
+ * executed recomp.tier_threshold instructions. Instructions are only
+ * decoded, their code stays the stub calling dynarec_notcompiled, so the
+ * dynarec comes back here when entering them. Returns 0 if the page of the
+ * instruction is already hot and should be recompiled. */
+static int dynarec_interpret_cold(struct r4300_core* r4300)
+{
+    struct cached_interp* const cinterp = &r4300->cached_interp;
+    struct precomp_instr** const pc = r4300_pc_struct(r4300);
+
+    if (cinterp->actual->heat >= r4300->recomp.tier_threshold) {
+        return 0;
+    }
+
+    r4300->recomp.cold_interp = 1;
+
+    while (!*r4300_stop(r4300))
+    {
+        struct precomp_block* const block = cinterp->actual;
+
+        if (block->heat >= r4300->recomp.tier_threshold)
+        {
+            /* go back to the dynarec, unless we're past the end of the page */
+            if (*pc - block->block < get_block_length(block)) {
+                break;
+            }
+        }
+        else {
+            ++block->heat;
+        }
+
+        if ((*pc)->ops == cinterp->not_compiled || (*pc)->ops == cinterp->not_compiled2)
+        {
+            const uint32_t* mem = fast_mem_access(r4300, block->start);
+            if (mem == NULL) {
+                break;
+            }
+
+            cached_interp_recompile_block(r4300, mem, block, (*pc)->addr);
+        }
+
+        /* same setup as for interpreted instructions in gencallinterp */
+        r4300->recomp.dyna_interp = 1;
+        (*pc)->ops();
+    }
+
+    r4300->recomp.dyna_interp = 0;
+    r4300->recomp.cold_interp = 0;
+    return 1;
+}
+
 void dynarec_notcompiled(void)
 {
-    cached_interp_NOTCOMPILED();
+    struct r4300_core* r4300 = &g_dev.r4300;
+
+    /* don't nest when an interpreted instruction runs another one */
+    if (!r4300->recomp.tiered || r4300->recomp.cold_interp || !dynarec_interpret_cold(r4300)) {
+        cached_interp_NOTCOMPILED();
+    }
     dyna_jump();
 }
 
@@ -69,6 +69,11 @@ struct precomp_instr
     } f;
     uint32_t addr; /* word-aligned instruction address in r4300 address space */
 
+    /* cached interpreter specific: instruction (and its block) reached the
+     * last time this jump left its block, see cached_interp_jump_linked */
+    struct precomp_instr* link;
+    struct precomp_block* link_block;
+
     /* these fields are recomp specific */
     unsigned int local_addr; /* byte offset to start of corresponding x86_64 instructions, from start of code block */
     struct reg_cache reg_cache_infos;
@@ -89,6 +94,9 @@ struct precomp_block
     void *riprel_table;
     int riprel_number;
     uint64_t xxhash;
+
+    /* instructions interpreted before the block gets recompiled (tiered dynarec) */
+    unsigned int heat;
 };
 
 #endif /* M64P_DEVICE_R4300_RECOMP_TYPES_H */
@@ -748,11 +748,15 @@ void gen_SB(struct r4300_core* r4300)
     mov_reg32_reg32(EBX, EAX);
     shr_reg32_imm8(EBX, 12);
     cmp_preg32pimm32_imm8(EBX, (unsigned int)r4300->cached_interp.invalid_code, 0);
-    jne_rj(54);
+    jne_rj(73);
 
     mov_reg32_reg32(ECX, EBX); // 2
-    shl_reg32_imm8(EBX, 2); // 3
-    mov_reg32_preg32pimm32(EBX, EBX, (unsigned int)r4300->cached_interp.blocks); // 6
+    shr_reg32_imm8(EBX, CACHED_INTERP_BLOCK_TABLE_BITS); // 3
+    mov_reg32_preg32x4pimm32(EBX, EBX, (unsigned int)r4300->cached_interp.blocks); // 7
+    mov_reg32_reg32(EDX, ECX); // 2
+    and_reg32_imm32(EDX, CACHED_INTERP_BLOCK_TABLE_SIZE - 1); // 6
+    shl_reg32_imm8(EDX, 2); // 3
+    mov_reg32_preg32preg32pimm32(EBX, EBX, EDX, 0); // 7
     mov_reg32_preg32pimm32(EBX, EBX, (int)&r4300->cached_interp.actual->block - (int)r4300->cached_interp.actual); // 6
     and_eax_imm32(0xFFF); // 5
     shr_reg32_imm8(EAX, 2); // 3
@@ -829,10 +833,14 @@ void gen_SH(struct r4300_core* r4300)
     mov_reg32_reg32(EBX, EAX);
     shr_reg32_imm8(EBX, 12);
     cmp_preg32pimm32_imm8(EBX, (unsigned int)r4300->cached_interp.invalid_code, 0);
-    jne_rj(54);
+    jne_rj(73);
     mov_reg32_reg32(ECX, EBX); // 2
-    shl_reg32_imm8(EBX, 2); // 3
-    mov_reg32_preg32pimm32(EBX, EBX, (unsigned int)r4300->cached_interp.blocks); // 6
+    shr_reg32_imm8(EBX, CACHED_INTERP_BLOCK_TABLE_BITS); // 3
+    mov_reg32_preg32x4pimm32(EBX, EBX, (unsigned int)r4300->cached_interp.blocks); // 7
+    mov_reg32_reg32(EDX, ECX); // 2
+    and_reg32_imm32(EDX, CACHED_INTERP_BLOCK_TABLE_SIZE - 1); // 6
+    shl_reg32_imm8(EDX, 2); // 3
+    mov_reg32_preg32preg32pimm32(EBX, EBX, EDX, 0); // 7
     mov_reg32_preg32pimm32(EBX, EBX, (int)&r4300->cached_interp.actual->block - (int)r4300->cached_interp.actual); // 6
     and_eax_imm32(0xFFF); // 5
     shr_reg32_imm8(EAX, 2); // 3
@@ -899,10 +907,14 @@ void gen_SW(struct r4300_core* r4300)
     mov_reg32_reg32(EBX, EAX);
     shr_reg32_imm8(EBX, 12);
     cmp_preg32pimm32_imm8(EBX, (unsigned int)r4300->cached_interp.invalid_code, 0);
-    jne_rj(54);
+    jne_rj(73);
     mov_reg32_reg32(ECX, EBX); // 2
-    shl_reg32_imm8(EBX, 2); // 3
-    mov_reg32_preg32pimm32(EBX, EBX, (unsigned int)r4300->cached_interp.blocks); // 6
+    shr_reg32_imm8(EBX, CACHED_INTERP_BLOCK_TABLE_BITS); // 3
+    mov_reg32_preg32x4pimm32(EBX, EBX, (unsigned int)r4300->cached_interp.blocks); // 7
+    mov_reg32_reg32(EDX, ECX); // 2
+    and_reg32_imm32(EDX, CACHED_INTERP_BLOCK_TABLE_SIZE - 1); // 6
+    shl_reg32_imm8(EDX, 2); // 3
+    mov_reg32_preg32preg32pimm32(EBX, EBX, EDX, 0); // 7
     mov_reg32_preg32pimm32(EBX, EBX, (int)&r4300->cached_interp.actual->block - (int)r4300->cached_interp.actual); // 6
     and_eax_imm32(0xFFF); // 5
     shr_reg32_imm8(EAX, 2); // 3
@@ -977,10 +989,14 @@ void gen_SD(struct r4300_core* r4300)
     mov_reg32_reg32(EBX, EAX);
     shr_reg32_imm8(EBX, 12);
     cmp_preg32pimm32_imm8(EBX, (unsigned int)r4300->cached_interp.invalid_code, 0);
-    jne_rj(54);
+    jne_rj(73);
     mov_reg32_reg32(ECX, EBX); // 2
-    shl_reg32_imm8(EBX, 2); // 3
-    mov_reg32_preg32pimm32(EBX, EBX, (unsigned int)r4300->cached_interp.blocks); // 6
+    shr_reg32_imm8(EBX, CACHED_INTERP_BLOCK_TABLE_BITS); // 3
+    mov_reg32_preg32x4pimm32(EBX, EBX, (unsigned int)r4300->cached_interp.blocks); // 7
+    mov_reg32_reg32(EDX, ECX); // 2
+    and_reg32_imm32(EDX, CACHED_INTERP_BLOCK_TABLE_SIZE - 1); // 6
+    shl_reg32_imm8(EDX, 2); // 3
+    mov_reg32_preg32preg32pimm32(EBX, EBX, EDX, 0); // 7
     mov_reg32_preg32pimm32(EBX, EBX, (int)&r4300->cached_interp.actual->block - (int)r4300->cached_interp.actual); // 6
     and_eax_imm32(0xFFF); // 5
     shr_reg32_imm8(EAX, 2); // 3
@@ -4269,10 +4285,14 @@ void gen_SWC1(struct r4300_core* r4300)
     mov_reg32_reg32(EBX, EAX);
     shr_reg32_imm8(EBX, 12);
     cmp_preg32pimm32_imm8(EBX, (unsigned int)r4300->cached_interp.invalid_code, 0);
-    jne_rj(54);
+    jne_rj(73);
     mov_reg32_reg32(ECX, EBX); // 2
-    shl_reg32_imm8(EBX, 2); // 3
-    mov_reg32_preg32pimm32(EBX, EBX, (unsigned int)r4300->cached_interp.blocks); // 6
+    shr_reg32_imm8(EBX, CACHED_INTERP_BLOCK_TABLE_BITS); // 3
+    mov_reg32_preg32x4pimm32(EBX, EBX, (unsigned int)r4300->cached_interp.blocks); // 7
+    mov_reg32_reg32(EDX, ECX); // 2
+    and_reg32_imm32(EDX, CACHED_INTERP_BLOCK_TABLE_SIZE - 1); // 6
+    shl_reg32_imm8(EDX, 2); // 3
+    mov_reg32_preg32preg32pimm32(EBX, EBX, EDX, 0); // 7
     mov_reg32_preg32pimm32(EBX, EBX, (int)&r4300->cached_interp.actual->block - (int)r4300->cached_interp.actual); // 6
     and_eax_imm32(0xFFF); // 5
     shr_reg32_imm8(EAX, 2); // 3
@@ -4337,10 +4357,14 @@ void gen_SDC1(struct r4300_core* r4300)
     mov_reg32_reg32(EBX, EAX);
     shr_reg32_imm8(EBX, 12);
     cmp_preg32pimm32_imm8(EBX, (unsigned int)r4300->cached_interp.invalid_code, 0);
-    jne_rj(54);
+    jne_rj(73);
     mov_reg32_reg32(ECX, EBX); // 2
-    shl_reg32_imm8(EBX, 2); // 3
-    mov_reg32_preg32pimm32(EBX, EBX, (unsigned int)r4300->cached_interp.blocks); // 6
+    shr_reg32_imm8(EBX, CACHED_INTERP_BLOCK_TABLE_BITS); // 3
+    mov_reg32_preg32x4pimm32(EBX, EBX, (unsigned int)r4300->cached_interp.blocks); // 7
+    mov_reg32_reg32(EDX, ECX); // 2
+    and_reg32_imm32(EDX, CACHED_INTERP_BLOCK_TABLE_SIZE - 1); // 6
+    shl_reg32_imm8(EDX, 2); // 3
+    mov_reg32_preg32preg32pimm32(EBX, EBX, EDX, 0); // 7
     mov_reg32_preg32pimm32(EBX, EBX, (int)&r4300->cached_interp.actual->block - (int)r4300->cached_interp.actual); // 6
     and_eax_imm32(0xFFF); // 5
     shr_reg32_imm8(EAX, 2); // 3
@@ -949,11 +949,15 @@ void gen_SB(struct r4300_core* r4300)
     mov_reg32_reg32(EBX, EAX);
     shr_reg32_imm8(EBX, 12);
     cmp_preg64preg64_imm8(RBX, RSI, 0);
-    jne_rj(65);
+    jne_rj(80);
 
     mov_reg64_imm64(RDI, (unsigned long long) r4300->cached_interp.blocks); // 10
     mov_reg32_reg32(ECX, EBX); // 2
+    shr_reg32_imm8(EBX, CACHED_INTERP_BLOCK_TABLE_BITS); // 3
     mov_reg64_preg64x8preg64(RBX, RBX, RDI);  // 4
+    mov_reg32_reg32(EDI, ECX); // 2
+    and_reg32_imm32(EDI, CACHED_INTERP_BLOCK_TABLE_SIZE - 1); // 6
+    mov_reg64_preg64x8preg64(RBX, RDI, RBX);  // 4
     mov_reg64_preg64pimm32(RBX, RBX, (int) offsetof(struct precomp_block, block)); // 7
     mov_reg64_imm64(RDI, (unsigned long long) dynarec_notcompiled); // 10
     and_eax_imm32(0xFFF); // 5
@@ -1038,11 +1042,15 @@ void gen_SH(struct r4300_core* r4300)
     mov_reg32_reg32(EBX, EAX);
     shr_reg32_imm8(EBX, 12);
     cmp_preg64preg64_imm8(RBX, RSI, 0);
-    jne_rj(65);
+    jne_rj(80);
 
     mov_reg64_imm64(RDI, (unsigned long long) r4300->cached_interp.blocks); // 10
     mov_reg32_reg32(ECX, EBX); // 2
+    shr_reg32_imm8(EBX, CACHED_INTERP_BLOCK_TABLE_BITS); // 3
     mov_reg64_preg64x8preg64(RBX, RBX, RDI);  // 4
+    mov_reg32_reg32(EDI, ECX); // 2
+    and_reg32_imm32(EDI, CACHED_INTERP_BLOCK_TABLE_SIZE - 1); // 6
+    mov_reg64_preg64x8preg64(RBX, RDI, RBX);  // 4
     mov_reg64_preg64pimm32(RBX, RBX, (int) offsetof(struct precomp_block, block)); // 7
     mov_reg64_imm64(RDI, (unsigned long long) dynarec_notcompiled); // 10
     and_eax_imm32(0xFFF); // 5
@@ -1121,11 +1129,15 @@ void gen_SW(struct r4300_core* r4300)
     mov_reg32_reg32(EBX, EAX);
     shr_reg32_imm8(EBX, 12);
     cmp_preg64preg64_imm8(RBX, RSI, 0);
-    jne_rj(65);
+    jne_rj(80);
 
     mov_reg64_imm64(RDI, (unsigned long long) r4300->cached_interp.blocks); // 10
     mov_reg32_reg32(ECX, EBX); // 2
+    shr_reg32_imm8(EBX, CACHED_INTERP_BLOCK_TABLE_BITS); // 3
     mov_reg64_preg64x8preg64(RBX, RBX, RDI);  // 4
+    mov_reg32_reg32(EDI, ECX); // 2
+    and_reg32_imm32(EDI, CACHED_INTERP_BLOCK_TABLE_SIZE - 1); // 6
+    mov_reg64_preg64x8preg64(RBX, RDI, RBX);  // 4
     mov_reg64_preg64pimm32(RBX, RBX, (int) offsetof(struct precomp_block, block)); // 7
     mov_reg64_imm64(RDI, (unsigned long long) dynarec_notcompiled); // 10
     and_eax_imm32(0xFFF); // 5
@@ -1214,11 +1226,15 @@ void gen_SD(struct r4300_core* r4300)
     mov_reg32_reg32(EBX, EAX);
     shr_reg32_imm8(EBX, 12);
     cmp_preg64preg64_imm8(RBX, RSI, 0);
-    jne_rj(65);
+    jne_rj(80);
 
     mov_reg64_imm64(RDI, (unsigned long long) r4300->cached_interp.blocks); // 10
     mov_reg32_reg32(ECX, EBX); // 2
+    shr_reg32_imm8(EBX, CACHED_INTERP_BLOCK_TABLE_BITS); // 3
     mov_reg64_preg64x8preg64(RBX, RBX, RDI);  // 4
+    mov_reg32_reg32(EDI, ECX); // 2
+    and_reg32_imm32(EDI, CACHED_INTERP_BLOCK_TABLE_SIZE - 1); // 6
+    mov_reg64_preg64x8preg64(RBX, RDI, RBX);  // 4
     mov_reg64_preg64pimm32(RBX, RBX, (int) offsetof(struct precomp_block, block)); // 7
     mov_reg64_imm64(RDI, (unsigned long long) dynarec_notcompiled); // 10
     and_eax_imm32(0xFFF); // 5
@@ -4495,11 +4511,15 @@ void gen_SWC1(struct r4300_core* r4300)
     mov_reg32_reg32(EBX, EAX);
     shr_reg32_imm8(EBX, 12);
     cmp_preg64preg64_imm8(RBX, RSI, 0);
-    jne_rj(65);
+    jne_rj(80);
 
     mov_reg64_imm64(RDI, (unsigned long long) r4300->cached_interp.blocks); // 10
     mov_reg32_reg32(ECX, EBX); // 2
+    shr_reg32_imm8(EBX, CACHED_INTERP_BLOCK_TABLE_BITS); // 3
     mov_reg64_preg64x8preg64(RBX, RBX, RDI);  // 4
+    mov_reg32_reg32(EDI, ECX); // 2
+    and_reg32_imm32(EDI, CACHED_INTERP_BLOCK_TABLE_SIZE - 1); // 6
+    mov_reg64_preg64x8preg64(RBX, RDI, RBX);  // 4
     mov_reg64_preg64pimm32(RBX, RBX, (int) offsetof(struct precomp_block, block)); // 7
     mov_reg64_imm64(RDI, (unsigned long long) dynarec_notcompiled); // 10
     and_eax_imm32(0xFFF); // 5
@@ -4573,11 +4593,15 @@ void gen_SDC1(struct r4300_core* r4300)
     mov_reg32_reg32(EBX, EAX);
     shr_reg32_imm8(EBX, 12);
     cmp_preg64preg64_imm8(RBX, RSI, 0);
-    jne_rj(65);
+    jne_rj(80);
 
     mov_reg64_imm64(RDI, (unsigned long long) r4300->cached_interp.blocks); // 10
     mov_reg32_reg32(ECX, EBX); // 2
+    shr_reg32_imm8(EBX, CACHED_INTERP_BLOCK_TABLE_BITS); // 3
     mov_reg64_preg64x8preg64(RBX, RBX, RDI);  // 4
+    mov_reg32_reg32(EDI, ECX); // 2
+    and_reg32_imm32(EDI, CACHED_INTERP_BLOCK_TABLE_SIZE - 1); // 6
+    mov_reg64_preg64x8preg64(RBX, RDI, RBX);  // 4
     mov_reg64_preg64pimm32(RBX, RBX, (int) offsetof(struct precomp_block, block)); // 7
     mov_reg64_imm64(RDI, (unsigned long long) dynarec_notcompiled); // 10
     and_eax_imm32(0xFFF); // 5
@@ -157,10 +157,14 @@ void write_vi_regs(void* opaque, uint32_t address, uint32_t value, uint32_t mask
 void vi_vertical_interrupt_event(void* opaque)
 {
     struct vi_controller* vi = (struct vi_controller*)opaque;
-    if (vi->dp->do_on_unfreeze & DELAY_DP_INT)
-        vi->dp->do_on_unfreeze |= DELAY_UPDATESCREEN;
-    else
-        gfx.updateScreen();
+    /* frames on the way to a movie seek target are not shown */
+    if (!main_is_replaying())
+    {
+        if (vi->dp->do_on_unfreeze & DELAY_DP_INT)
+            vi->dp->do_on_unfreeze |= DELAY_UPDATESCREEN;
+        else
+            gfx.updateScreen();
+    }
 
     /* allow main module to do things on VI event */
     new_vi();
@@ -0,0 +1,58 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - encoder_backend.hpp                                     *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_ENCODER_BACKEND_HPP
+#define M64P_ENCODER_BACKEND_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// one frame as returned by the video plugin's ReadScreen2: RGB24, bottom row first
+struct enc_video_frame {
+    int width             = 0;
+    int height            = 0;
+    const uint8_t* pixels = nullptr;
+};
+
+// one AI DMA buffer: 32-bit words holding a 16-bit left and right sample each
+struct enc_audio_chunk {
+    unsigned int sample_rate = 0;
+    size_t size              = 0;  // in bytes
+    const uint8_t* samples   = nullptr;
+};
+
+/* Output side of the encoder. It is only ever driven by the encoder thread.
+ * push_* return false after a fatal error, further data is then ignored. */
+class encoder_backend {
+public:
+    virtual ~encoder_backend() = default;
+
+    virtual bool push_video(const enc_video_frame& frame) = 0;
+    virtual bool push_audio(const enc_audio_chunk& chunk) = 0;
+
+    // flushes and closes the output, or deletes it if discard is set
+    virtual bool finish(bool discard) = 0;
+
+    // audio-only outputs return false, the screen is then never read back
+    virtual bool wants_video() const { return true; }
+};
+
+#endif // M64P_ENCODER_BACKEND_HPP
@@ -0,0 +1,418 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - ffm_encoder.cpp                                         *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "ffm_encoder.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "ffm_helpers.hpp"
+#include "rgb_yuv.hpp"
+
+extern "C" {
+#include "api/callbacks.h"
+#include "osal/files.h"
+#include <libavutil/channel_layout.h>
+#include <libavutil/samplefmt.h>
+}
+
+ffm_encoder::~ffm_encoder() {
+    if (m_fmt != NULL && !(m_fmt->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&m_fmt->pb);
+    avformat_free_context(m_fmt);
+
+    avcodec_free_context(&m_vctx);
+    av_frame_free(&m_vframe);
+    sws_freeContext(m_sws);
+
+    avcodec_free_context(&m_actx);
+    av_frame_free(&m_aframe);
+    swr_free(&m_swr);
+    if (m_fifo != NULL)
+        av_audio_fifo_free(m_fifo);
+    if (m_convert != NULL)
+        av_freep(&m_convert[0]);
+    av_freep(&m_convert);
+
+    av_packet_free(&m_packet);
+    av_dict_free(&m_video_opts);
+    av_dict_free(&m_audio_opts);
+    av_dict_free(&m_format_opts);
+}
+
+m64p_error ffm_encoder::open(
+    const char* path, const char* format, unsigned int fps, unsigned int sample_rate
+) {
+    int err = avformat_alloc_output_context2(&m_fmt, NULL, format, path);
+    if (err < 0 || m_fmt == NULL) {
+        DebugMessage(
+            M64MSG_ERROR, "Encoder: no muxer for '%s': %s", format != NULL ? format : path,
+            ffm_error_string(err).c_str()
+        );
+        return M64ERR_INPUT_INVALID;
+    }
+
+    m_packet = av_packet_alloc();
+    if (m_packet == NULL)
+        return M64ERR_NO_MEMORY;
+
+    // the config can only be read from the thread that called Encoder_Start
+    m_video_opts  = ffm_section_options("EncFFmpeg-Video");
+    m_audio_opts  = ffm_section_options("EncFFmpeg-Audio");
+    m_format_opts = ffm_section_options("EncFFmpeg-Format");
+
+    m_has_video = m_fmt->oformat->video_codec != AV_CODEC_ID_NONE ||
+        av_dict_get(m_video_opts, "codec", NULL, 0) != NULL;
+    m_has_audio = m_fmt->oformat->audio_codec != AV_CODEC_ID_NONE ||
+        av_dict_get(m_audio_opts, "codec", NULL, 0) != NULL;
+
+    if (!(m_fmt->oformat->flags & AVFMT_NOFILE)) {
+        err = avio_open(&m_fmt->pb, path, AVIO_FLAG_WRITE);
+        if (err < 0) {
+            DebugMessage(
+                M64MSG_ERROR, "Encoder: couldn't open '%s': %s", path, ffm_error_string(err).c_str()
+            );
+            return M64ERR_FILES;
+        }
+    }
+
+    m_path        = path;
+    m_fps         = fps;
+    m_sample_rate = sample_rate;
+    return M64ERR_SUCCESS;
+}
+
+bool ffm_encoder::fail(const char* what, int err) {
+    DebugMessage(M64MSG_ERROR, "Encoder: %s: %s", what, ffm_error_string(err).c_str());
+    m_failed = true;
+    return false;
+}
+
+bool ffm_encoder::open_video(int width, int height) {
+    const AVCodec* codec = ffm_find_encoder(&m_video_opts, m_fmt->oformat->video_codec);
+    int err;
+
+    if (codec == NULL || codec->type != AVMEDIA_TYPE_VIDEO)
+        return fail("no video encoder", AVERROR_ENCODER_NOT_FOUND);
+
+    m_vstream = avformat_new_stream(m_fmt, NULL);
+    m_vctx    = avcodec_alloc_context3(codec);
+    m_vframe  = av_frame_alloc();
+    if (m_vstream == NULL || m_vctx == NULL || m_vframe == NULL)
+        return fail("video stream", AVERROR(ENOMEM));
+
+    // most pixel formats codecs want are subsampled by 2
+    m_vctx->width     = width & ~1;
+    m_vctx->height    = height & ~1;
+    m_vctx->pix_fmt   = codec->pix_fmts != NULL ? codec->pix_fmts[0] : AV_PIX_FMT_YUV420P;
+    m_vctx->time_base = AVRational {1, (int) m_fps};
+    m_vctx->framerate = AVRational {(int) m_fps, 1};
+    if (m_fmt->oformat->flags & AVFMT_GLOBALHEADER)
+        m_vctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    if ((err = avcodec_open2(m_vctx, codec, &m_video_opts)) < 0)
+        return fail("couldn't open the video encoder", err);
+    ffm_warn_unused(m_video_opts, codec->name);
+
+    if ((err = avcodec_parameters_from_context(m_vstream->codecpar, m_vctx)) < 0)
+        return fail("video stream", err);
+    m_vstream->time_base = m_vctx->time_base;
+
+    m_vframe->format = m_vctx->pix_fmt;
+    m_vframe->width  = m_vctx->width;
+    m_vframe->height = m_vctx->height;
+    if ((err = av_frame_get_buffer(m_vframe, 0)) < 0)
+        return fail("video frame", err);
+
+    return true;
+}
+
+bool ffm_encoder::open_audio() {
+    const AVCodec* codec = ffm_find_encoder(&m_audio_opts, m_fmt->oformat->audio_codec);
+    int rate             = (int) m_sample_rate;
+    int err;
+
+    if (codec == NULL || codec->type != AVMEDIA_TYPE_AUDIO)
+        return fail("no audio encoder", AVERROR_ENCODER_NOT_FOUND);
+
+    m_astream = avformat_new_stream(m_fmt, NULL);
+    m_actx    = avcodec_alloc_context3(codec);
+    m_aframe  = av_frame_alloc();
+    if (m_astream == NULL || m_actx == NULL || m_aframe == NULL)
+        return fail("audio stream", AVERROR(ENOMEM));
+
+    // resample to the closest rate the codec supports
+    if (codec->supported_samplerates != NULL) {
+        int best = codec->supported_samplerates[0];
+        for (const int* p = codec->supported_samplerates; *p != 0; ++p) {
+            if (std::abs(*p - rate) < std::abs(best - rate))
+                best = *p;
+        }
+        rate = best;
+    }
+
+    m_actx->sample_fmt  = codec->sample_fmts != NULL ? codec->sample_fmts[0] : AV_SAMPLE_FMT_S16;
+    m_actx->sample_rate = rate;
+    m_actx->time_base   = AVRational {1, rate};
+    av_channel_layout_default(&m_actx->ch_layout, 2);
+    if (m_fmt->oformat->flags & AVFMT_GLOBALHEADER)
+        m_actx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    if ((err = avcodec_open2(m_actx, codec, &m_audio_opts)) < 0)
+        return fail("couldn't open the audio encoder", err);
+    ffm_warn_unused(m_audio_opts, codec->name);
+
+    if ((err = avcodec_parameters_from_context(m_astream->codecpar, m_actx)) < 0)
+        return fail("audio stream", err);
+    m_astream->time_base = m_actx->time_base;
+
+    m_frame_size = (m_actx->frame_size > 0 && !(codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE))
+        ? m_actx->frame_size
+        : 1024;
+
+    m_aframe->format      = m_actx->sample_fmt;
+    m_aframe->sample_rate = m_actx->sample_rate;
+    m_aframe->nb_samples  = m_frame_size;
+    if ((err = av_channel_layout_copy(&m_aframe->ch_layout, &m_actx->ch_layout)) < 0 ||
+        (err = av_frame_get_buffer(m_aframe, 0)) < 0)
+        return fail("audio frame", err);
+
+    m_fifo = av_audio_fifo_alloc(m_actx->sample_fmt, m_actx->ch_layout.nb_channels, m_frame_size);
+    if (m_fifo == NULL)
+        return fail("audio buffer", AVERROR(ENOMEM));
+
+    return true;
+}
+
+bool ffm_encoder::open_streams(int width, int height) {
+    int err;
+
+    if ((m_has_video && !open_video(width, height)) || (m_has_audio && !open_audio()))
+        return false;
+
+    if ((err = avformat_write_header(m_fmt, &m_format_opts)) < 0)
+        return fail("couldn't write the header", err);
+    ffm_warn_unused(m_format_opts, m_fmt->oformat->name);
+
+    m_open = true;
+    if (!m_early.empty()) {
+        if (!write_audio(m_early.data(), (int) (m_early.size() / 2), m_sample_rate))
+            return false;
+        m_early.clear();
+        m_early.shrink_to_fit();
+    }
+    return true;
+}
+
+bool ffm_encoder::send(AVCodecContext* ctx, AVStream* stream, const AVFrame* frame) {
+    int err = avcodec_send_frame(ctx, frame);
+    if (err < 0)
+        return fail(avcodec_get_name(ctx->codec_id), err);
+
+    while ((err = avcodec_receive_packet(ctx, m_packet)) >= 0) {
+        av_packet_rescale_ts(m_packet, ctx->time_base, stream->time_base);
+        m_packet->stream_index = stream->index;
+        if ((err = av_interleaved_write_frame(m_fmt, m_packet)) < 0)
+            return fail("couldn't write a packet", err);
+    }
+
+    if (err != AVERROR(EAGAIN) && err != AVERROR_EOF)
+        return fail(avcodec_get_name(ctx->codec_id), err);
+    return true;
+}
+
+bool ffm_encoder::push_video(const enc_video_frame& frame) {
+    int err;
+
+    if (m_failed)
+        return false;
+    if (frame.width <= 0 || frame.height <= 0)
+        return true;
+    if (!m_open && !open_streams(frame.width, frame.height))
+        return false;
+    if (m_vctx == NULL)
+        return true;
+
+    if ((err = av_frame_make_writable(m_vframe)) < 0)
+        return fail("video frame", err);
+
+    // rows come bottom-up, walk them backwards
+    const int stride    = frame.width * 3;
+    const uint8_t* last = frame.pixels + (size_t) stride * (frame.height - 1);
+
+    // the most common case skips swscale's generic pipeline
+    if (m_vctx->pix_fmt == AV_PIX_FMT_YUV420P && (frame.width & ~1) == m_vctx->width &&
+        (frame.height & ~1) == m_vctx->height) {
+        rgb24_to_yuv420(
+            last, -stride, m_vctx->width, m_vctx->height, m_vframe->data[0], m_vframe->linesize[0],
+            m_vframe->data[1], m_vframe->data[2], m_vframe->linesize[1]
+        );
+        m_vframe->pts = m_vpts++;
+        return send(m_vctx, m_vstream, m_vframe);
+    }
+
+    m_sws = sws_getCachedContext(
+        m_sws, frame.width, frame.height, AV_PIX_FMT_RGB24, m_vctx->width, m_vctx->height,
+        m_vctx->pix_fmt, SWS_BICUBIC, NULL, NULL, NULL
+    );
+    if (m_sws == NULL)
+        return fail("no conversion to the encoder's pixel format", AVERROR(EINVAL));
+
+    const uint8_t* src[1]   = {last};
+    const int src_stride[1] = {-stride};
+    sws_scale(m_sws, src, src_stride, 0, frame.height, m_vframe->data, m_vframe->linesize);
+
+    m_vframe->pts = m_vpts++;
+    return send(m_vctx, m_vstream, m_vframe);
+}
+
+bool ffm_encoder::push_audio(const enc_audio_chunk& chunk) {
+    size_t count = chunk.size / 4;
+    uint32_t word;
+
+    if (m_failed)
+        return false;
+
+    // each word holds the left sample in its high half, whatever the host order
+    m_samples.resize(count * 2);
+    for (size_t i = 0; i < count; ++i) {
+        memcpy(&word, chunk.samples + i * 4, 4);
+        m_samples[i * 2]     = (int16_t) (word >> 16);
+        m_samples[i * 2 + 1] = (int16_t) (word & 0xffff);
+    }
+
+    if (!m_open) {
+        // hold the audio until the first frame gives the picture size
+        if (m_has_video) {
+            if (chunk.sample_rate != 0)
+                m_sample_rate = chunk.sample_rate;
+            m_early.insert(m_early.end(), m_samples.begin(), m_samples.end());
+            return true;
+        }
+        if (!open_streams(0, 0))
+            return false;
+    }
+
+    return write_audio(m_samples.data(), (int) count, chunk.sample_rate);
+}
+
+bool ffm_encoder::write_audio(const int16_t* samples, int count, unsigned int rate) {
+    int err, out;
+
+    if (m_actx == NULL || count == 0)
+        return true;
+    if (rate == 0)
+        rate = m_sample_rate;
+
+    if (m_swr == NULL || rate != m_swr_rate) {
+        AVChannelLayout stereo;
+        av_channel_layout_default(&stereo, 2);
+
+        swr_free(&m_swr);
+        err = swr_alloc_set_opts2(
+            &m_swr, &m_actx->ch_layout, m_actx->sample_fmt, m_actx->sample_rate, &stereo,
+            AV_SAMPLE_FMT_S16, (int) rate, 0, NULL
+        );
+        if (err >= 0)
+            err = swr_init(m_swr);
+        if (err < 0)
+            return fail("couldn't set up resampling", err);
+        m_swr_rate = rate;
+    }
+
+    out = swr_get_out_samples(m_swr, count);
+    if (out > m_convert_capacity) {
+        if (m_convert != NULL)
+            av_freep(&m_convert[0]);
+        av_freep(&m_convert);
+        err = av_samples_alloc_array_and_samples(
+            &m_convert, NULL, m_actx->ch_layout.nb_channels, out, m_actx->sample_fmt, 0
+        );
+        if (err < 0) {
+            m_convert_capacity = 0;
+            return fail("audio buffer", err);
+        }
+        m_convert_capacity = out;
+    }
+
+    const uint8_t* in[1] = {(const uint8_t*) samples};
+    if ((out = swr_convert(m_swr, m_convert, out, in, count)) < 0)
+        return fail("resampling", out);
+    if (av_audio_fifo_write(m_fifo, (void**) m_convert, out) < out)
+        return fail("audio buffer", AVERROR(ENOMEM));
+
+    return drain_audio(false);
+}
+
+bool ffm_encoder::drain_audio(bool flush) {
+    int err, count;
+    bool small_last = (m_actx->codec->capabilities &
+                       (AV_CODEC_CAP_SMALL_LAST_FRAME | AV_CODEC_CAP_VARIABLE_FRAME_SIZE)) != 0;
+
+    while ((count = av_audio_fifo_size(m_fifo)) >= m_frame_size || (flush && count > 0)) {
+        if (count > m_frame_size)
+            count = m_frame_size;
+
+        // a frame still referenced by the encoder gets reallocated at its current size
+        m_aframe->nb_samples = m_frame_size;
+        if ((err = av_frame_make_writable(m_aframe)) < 0)
+            return fail("audio frame", err);
+
+        av_audio_fifo_read(m_fifo, (void**) m_aframe->data, count);
+        m_aframe->nb_samples = count;
+        if (count < m_frame_size && !small_last) {
+            av_samples_set_silence(
+                m_aframe->data, count, m_frame_size - count, m_actx->ch_layout.nb_channels,
+                m_actx->sample_fmt
+            );
+            m_aframe->nb_samples = m_frame_size;
+        }
+
+        m_aframe->pts = m_apts;
+        m_apts += count;
+        if (!send(m_actx, m_astream, m_aframe))
+            return false;
+    }
+    return true;
+}
+
+bool ffm_encoder::finish(bool discard) {
+    bool ok = !m_failed;
+
+    if (m_open && !discard) {
+        if (ok && m_actx != NULL)
+            ok = drain_audio(true) && send(m_actx, m_astream, NULL);
+        if (ok && m_vctx != NULL)
+            ok = send(m_vctx, m_vstream, NULL);
+        if (av_write_trailer(m_fmt) < 0)
+            ok = false;
+    }
+
+    if (!(m_fmt->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&m_fmt->pb);
+
+    if (!m_open && !discard)
+        DebugMessage(M64MSG_WARNING, "Encoder: nothing was captured to '%s'", m_path.c_str());
+    if (discard || !m_open)
+        unlink(m_path.c_str());
+
+    return ok;
+}
@@ -0,0 +1,106 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - ffm_encoder.hpp                                         *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_ENCODER_FFM_ENCODER_HPP
+#define M64P_ENCODER_FFM_ENCODER_HPP
+
+#include <string>
+#include <vector>
+
+#include "encoder_backend.hpp"
+
+extern "C" {
+#include "api/m64p_types.h"
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/audio_fifo.h>
+#include <libswresample/swresample.h>
+#include <libswscale/swscale.h>
+}
+
+/* Encodes and muxes with FFmpeg. The codecs and the muxer are configured from
+ * the EncFFmpeg-Video, EncFFmpeg-Audio and EncFFmpeg-Format config sections:
+ * every parameter there is passed on as an FFmpeg option, except "codec" which
+ * picks the encoder in place of the muxer's default one.
+ * Streams are created once the first frame tells the picture size. */
+class ffm_encoder : public encoder_backend {
+public:
+    ffm_encoder() = default;
+    ~ffm_encoder() override;
+
+    ffm_encoder(const ffm_encoder&)            = delete;
+    ffm_encoder& operator=(const ffm_encoder&) = delete;
+
+    // format is an FFmpeg muxer name, or NULL to guess it from the path
+    m64p_error open(const char* path, const char* format, unsigned int fps, unsigned int sample_rate);
+
+    bool push_video(const enc_video_frame& frame) override;
+    bool push_audio(const enc_audio_chunk& chunk) override;
+    bool finish(bool discard) override;
+    bool wants_video() const override { return m_has_video; }
+
+private:
+    bool fail(const char* what, int err);
+    bool open_streams(int width, int height);
+    bool open_video(int width, int height);
+    bool open_audio();
+    bool write_audio(const int16_t* samples, int count, unsigned int rate);
+    bool drain_audio(bool flush);
+    bool send(AVCodecContext* ctx, AVStream* stream, const AVFrame* frame);
+
+    std::string m_path;
+    unsigned int m_fps         = 60;
+    unsigned int m_sample_rate = 0;
+
+    AVDictionary* m_video_opts  = NULL;
+    AVDictionary* m_audio_opts  = NULL;
+    AVDictionary* m_format_opts = NULL;
+
+    AVFormatContext* m_fmt = NULL;
+    AVPacket* m_packet     = NULL;
+    bool m_has_video       = false;
+    bool m_has_audio       = false;
+    bool m_open            = false;
+    bool m_failed          = false;
+
+    AVCodecContext* m_vctx = NULL;
+    AVStream* m_vstream    = NULL;
+    AVFrame* m_vframe      = NULL;
+    SwsContext* m_sws      = NULL;
+    int64_t m_vpts         = 0;
+
+    AVCodecContext* m_actx    = NULL;
+    AVStream* m_astream       = NULL;
+    AVFrame* m_aframe         = NULL;
+    SwrContext* m_swr         = NULL;
+    unsigned int m_swr_rate   = 0;
+    AVAudioFifo* m_fifo       = NULL;
+    int m_frame_size          = 0;
+    uint8_t** m_convert       = NULL;
+    int m_convert_capacity    = 0;
+    int64_t m_apts            = 0;
+
+    // samples in host order, plus audio received before the streams exist
+    std::vector<int16_t> m_samples;
+    std::vector<int16_t> m_early;
+};
+
+#endif // M64P_ENCODER_FFM_ENCODER_HPP
@@ -0,0 +1,84 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - ffm_helpers.cpp                                         *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "ffm_helpers.hpp"
+
+#define M64P_CORE_PROTOTYPES 1
+extern "C" {
+#include "api/callbacks.h"
+#include "api/m64p_config.h"
+#include "api/m64p_types.h"
+#include <libavutil/error.h>
+}
+
+struct section_context {
+    m64p_handle handle;
+    AVDictionary** opts;
+};
+
+static void section_param(void* context, const char* name, m64p_type type) {
+    auto ctx          = (section_context*) context;
+    const char* value = ConfigGetParamString(ctx->handle, name);
+
+    if (value != NULL)
+        av_dict_set(ctx->opts, name, value, 0);
+}
+
+AVDictionary* ffm_section_options(const char* section) {
+    AVDictionary* opts = NULL;
+    m64p_handle handle;
+
+    if (ConfigOpenSection(section, &handle) != M64ERR_SUCCESS)
+        return NULL;
+
+    section_context ctx {handle, &opts};
+    ConfigListParameters(handle, &ctx, section_param);
+    return opts;
+}
+
+void ffm_warn_unused(AVDictionary* opts, const char* what) {
+    const AVDictionaryEntry* entry = NULL;
+
+    while ((entry = av_dict_get(opts, "", entry, AV_DICT_IGNORE_SUFFIX)) != NULL)
+        DebugMessage(M64MSG_WARNING, "Encoder: %s does not know option '%s'", what, entry->key);
+}
+
+const AVCodec* ffm_find_encoder(AVDictionary** opts, enum AVCodecID default_id) {
+    const AVDictionaryEntry* entry = av_dict_get(*opts, "codec", NULL, 0);
+    const AVCodec* codec;
+
+    if (entry == NULL)
+        return avcodec_find_encoder(default_id);
+
+    codec = avcodec_find_encoder_by_name(entry->value);
+    if (codec == NULL)
+        DebugMessage(M64MSG_ERROR, "Encoder: unknown codec '%s'", entry->value);
+
+    av_dict_set(opts, "codec", NULL, 0);
+    return codec;
+}
+
+std::string ffm_error_string(int err) {
+    char buf[AV_ERROR_MAX_STRING_SIZE];
+
+    av_strerror(err, buf, sizeof(buf));
+    return buf;
+}
@@ -0,0 +1,44 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - ffm_helpers.hpp                                         *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_ENCODER_FFM_HELPERS_HPP
+#define M64P_ENCODER_FFM_HELPERS_HPP
+
+#include <string>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/dict.h>
+}
+
+// collects the parameters of a config section as FFmpeg options
+AVDictionary* ffm_section_options(const char* section);
+
+// logs the options that FFmpeg did not recognise, 'what' names their consumer
+void ffm_warn_unused(AVDictionary* opts, const char* what);
+
+/* finds the encoder named by the "codec" option, which is removed from opts,
+ * or the default encoder of the muxer if there is none */
+const AVCodec* ffm_find_encoder(AVDictionary** opts, enum AVCodecID default_id);
+
+std::string ffm_error_string(int err);
+
+#endif // M64P_ENCODER_FFM_HELPERS_HPP
@@ -0,0 +1,238 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - raw_encoder.cpp                                         *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "raw_encoder.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "rgb_yuv.hpp"
+
+extern "C" {
+#include "api/callbacks.h"
+#include "osal/files.h"
+}
+
+static void put_le16(uint8_t* p, uint16_t value) {
+    p[0] = (uint8_t) value;
+    p[1] = (uint8_t) (value >> 8);
+}
+
+static void put_le32(uint8_t* p, uint32_t value) {
+    put_le16(p, (uint16_t) value);
+    put_le16(p + 2, (uint16_t) (value >> 16));
+}
+
+// 16-bit stereo PCM, sizes past 4GB are left at their maximum
+static void wav_header(uint8_t* header, unsigned int rate, uint64_t data_size) {
+    uint32_t size = data_size > 0xffffffff - 36 ? 0xffffffff - 36 : (uint32_t) data_size;
+
+    memcpy(header, "RIFF", 4);
+    put_le32(header + 4, size + 36);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_le32(header + 16, 16);
+    put_le16(header + 20, 1);
+    put_le16(header + 22, 2);
+    put_le32(header + 24, rate);
+    put_le32(header + 28, rate * 4);
+    put_le16(header + 32, 4);
+    put_le16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    put_le32(header + 40, size);
+}
+
+m64p_error raw_encoder::open(const char* path, unsigned int fps, unsigned int sample_rate, bool video) {
+    std::string audio = path;
+    uint8_t header[44];
+
+    if (video) {
+        size_t dot = audio.find_last_of('.');
+        size_t sep = audio.find_last_of("/\\");
+
+        if (dot != std::string::npos && (sep == std::string::npos || dot > sep))
+            audio.erase(dot);
+        audio += ".wav";
+        if (audio == path)
+            audio += ".wav";
+
+        if (!m_video.open(path)) {
+            DebugMessage(M64MSG_ERROR, "Encoder: couldn't open '%s'", path);
+            return M64ERR_FILES;
+        }
+    }
+    if (!m_audio.open(audio)) {
+        DebugMessage(M64MSG_ERROR, "Encoder: couldn't open '%s'", audio.c_str());
+        if (video) {
+            m_video.close();
+            unlink(path);
+        }
+        return M64ERR_FILES;
+    }
+
+    m_fps         = fps;
+    m_with_video  = video;
+    m_sample_rate = sample_rate != 0 ? sample_rate : 44100;
+
+    // the sizes are filled in by finish()
+    wav_header(header, m_sample_rate, 0);
+    if (!m_audio.write(header, sizeof(header)))
+        return M64ERR_FILES;
+    return M64ERR_SUCCESS;
+}
+
+bool raw_encoder::push_video(const enc_video_frame& frame) {
+    static const char tag[] = "FRAME\n";
+    const uint8_t* rgb      = frame.pixels;
+    int rows                = frame.height;
+    ptrdiff_t stride        = (ptrdiff_t) frame.width * 3;
+
+    if (m_failed)
+        return false;
+    if (frame.width < 2 || frame.height < 2)
+        return true;
+
+    if (m_width == 0) {
+        char header[80];
+        int n;
+
+        // 4:2:0 needs even sizes, the odd column or row is dropped
+        m_width  = frame.width & ~1;
+        m_height = frame.height & ~1;
+        m_yuv.resize((size_t) m_width * m_height * 3 / 2);
+
+        n = snprintf(
+            header, sizeof(header), "YUV4MPEG2 W%d H%d F%u:1 Ip A1:1 C420jpeg\n", m_width, m_height, m_fps
+        );
+        if (!m_video.write(header, (size_t) n)) {
+            DebugMessage(M64MSG_ERROR, "Encoder: couldn't write to '%s'", m_video.path().c_str());
+            m_failed = true;
+            return false;
+        }
+    }
+
+    if ((frame.width & ~1) != m_width || (frame.height & ~1) != m_height) {
+        // nearest neighbour is enough for the odd resolution switch
+        m_scaled.resize((size_t) m_width * m_height * 3);
+        for (int y = 0; y < m_height; ++y) {
+            const uint8_t* src = frame.pixels + (size_t) (y * frame.height / m_height) * stride;
+            uint8_t* dst       = m_scaled.data() + (size_t) y * m_width * 3;
+            for (int x = 0; x < m_width; ++x)
+                memcpy(dst + x * 3, src + (size_t) (x * frame.width / m_width) * 3, 3);
+        }
+        rgb    = m_scaled.data();
+        rows   = m_height;
+        stride = (ptrdiff_t) m_width * 3;
+    }
+
+    // rows come bottom-up, start from the top of the picture
+    uint8_t* y = m_yuv.data();
+    uint8_t* u = y + (size_t) m_width * m_height;
+    uint8_t* v = u + (size_t) m_width * m_height / 4;
+    rgb24_to_yuv420(rgb + (rows - 1) * stride, -stride, m_width, m_height, y, m_width, u, v, m_width / 2);
+
+    if (!m_video.write(tag, sizeof(tag) - 1) || !m_video.write(m_yuv.data(), m_yuv.size())) {
+        DebugMessage(M64MSG_ERROR, "Encoder: couldn't write to '%s'", m_video.path().c_str());
+        m_failed = true;
+        return false;
+    }
+    return true;
+}
+
+// linear interpolation, m_phase carries the position of the next output across chunks
+void raw_encoder::resample(const int16_t* samples, size_t count, unsigned int rate) {
+    double step = (double) rate / m_sample_rate;
+    double t    = m_phase;
+
+    m_resampled.clear();
+    while (t < (double) count - 1) {
+        ptrdiff_t i = (ptrdiff_t) std::floor(t);
+        double f    = t - (double) i;
+
+        for (int c = 0; c < 2; ++c) {
+            double a = i < 0 ? m_last[c] : samples[i * 2 + c];
+            double b = samples[(i + 1) * 2 + c];
+            m_resampled.push_back((int16_t) std::lrint(a + (b - a) * f));
+        }
+        t += step;
+    }
+    m_phase = t - (double) count;
+}
+
+bool raw_encoder::push_audio(const enc_audio_chunk& chunk) {
+    size_t count = chunk.size / 4;
+    uint32_t word;
+
+    if (m_failed)
+        return false;
+    if (count == 0)
+        return true;
+
+    // each word holds the left sample in its high half, whatever the host order
+    m_samples.resize(count * 2);
+    for (size_t i = 0; i < count; ++i) {
+        memcpy(&word, chunk.samples + i * 4, 4);
+        m_samples[i * 2]     = (int16_t) (word >> 16);
+        m_samples[i * 2 + 1] = (int16_t) (word & 0xffff);
+    }
+
+    std::vector<int16_t>* out = &m_samples;
+    if (chunk.sample_rate != 0 && chunk.sample_rate != m_sample_rate) {
+        resample(m_samples.data(), count, chunk.sample_rate);
+        out = &m_resampled;
+    }
+    else {
+        m_phase = 0.0;
+    }
+    m_last[0] = m_samples[count * 2 - 2];
+    m_last[1] = m_samples[count * 2 - 1];
+
+#ifdef M64P_BIG_ENDIAN
+    for (int16_t& sample : *out)
+        sample = (int16_t) (((uint16_t) sample >> 8) | ((uint16_t) sample << 8));
+#endif
+
+    if (!m_audio.write(out->data(), out->size() * sizeof(int16_t))) {
+        DebugMessage(M64MSG_ERROR, "Encoder: couldn't write to '%s'", m_audio.path().c_str());
+        m_failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool raw_encoder::finish(bool discard) {
+    bool ok = !m_failed;
+    uint8_t header[44];
+
+    if (!discard) {
+        wav_header(header, m_sample_rate, m_audio.size() - sizeof(header));
+        ok = m_audio.patch(0, header, sizeof(header)) && ok;
+    }
+
+    ok = m_video.close() && ok;
+    ok = m_audio.close() && ok;
+
+    if (m_with_video && (discard || m_width == 0))
+        unlink(m_video.path().c_str());
+    if (discard)
+        unlink(m_audio.path().c_str());
+    return ok;
+}
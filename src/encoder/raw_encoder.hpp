@@ -0,0 +1,73 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - raw_encoder.hpp                                         *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_ENCODER_RAW_ENCODER_HPP
+#define M64P_ENCODER_RAW_ENCODER_HPP
+
+#include <string>
+#include <vector>
+
+#include "encoder_backend.hpp"
+#include "raw_file.hpp"
+
+extern "C" {
+#include "api/m64p_types.h"
+}
+
+/* Uncompressed dump for encoding later: the picture goes to a Y4M file
+ * (YUV 4:2:0) and the sound to a 16-bit stereo WAV file next to it, or only
+ * the sound is captured. Both are plain sequential writes, so capturing costs
+ * little more than the copies.
+ * Frames that change size are scaled to the size of the first one, and audio
+ * is resampled to the rate it started with, as neither format can switch. */
+class raw_encoder : public encoder_backend {
+public:
+    // With video, path is the Y4M file and the WAV file gets the same name
+    // with a .wav extension. Without, path is the WAV file.
+    m64p_error open(const char* path, unsigned int fps, unsigned int sample_rate, bool video);
+
+    bool push_video(const enc_video_frame& frame) override;
+    bool push_audio(const enc_audio_chunk& chunk) override;
+    bool finish(bool discard) override;
+    bool wants_video() const override { return m_with_video; }
+
+private:
+    void resample(const int16_t* samples, size_t count, unsigned int rate);
+
+    raw_file m_video;
+    raw_file m_audio;
+    unsigned int m_fps = 60;
+    bool m_with_video  = true;
+    bool m_failed      = false;
+
+    int m_width  = 0;
+    int m_height = 0;
+    std::vector<uint8_t> m_yuv;
+    std::vector<uint8_t> m_scaled;
+
+    unsigned int m_sample_rate = 0;
+    std::vector<int16_t> m_samples;
+    std::vector<int16_t> m_resampled;
+    double m_phase    = 0.0;
+    int16_t m_last[2] = {0, 0};
+};
+
+#endif // M64P_ENCODER_RAW_ENCODER_HPP
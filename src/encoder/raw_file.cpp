@@ -0,0 +1,183 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - raw_file.cpp                                            *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "raw_file.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <malloc.h>
+extern "C" {
+#include "osal/files.h"
+}
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+raw_file::~raw_file() {
+    close();
+}
+
+bool raw_file::open(const std::string& path) {
+#ifdef _WIN32
+    m_buffer = (uint8_t*) _aligned_malloc(BUFFER_SIZE, BLOCK_SIZE);
+    if (m_buffer == nullptr)
+        return false;
+    m_file = osal_file_open(path.c_str(), "wb");
+    if (m_file == nullptr)
+        return false;
+#else
+    if (posix_memalign((void**) &m_buffer, BLOCK_SIZE, BUFFER_SIZE) != 0) {
+        m_buffer = nullptr;
+        return false;
+    }
+#ifdef O_DIRECT
+    m_fd     = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    m_direct = m_fd >= 0;
+#endif
+    // not every file system supports O_DIRECT
+    if (m_fd < 0)
+        m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0)
+        return false;
+#endif
+
+    m_path    = path;
+    m_used    = 0;
+    m_written = 0;
+    return true;
+}
+
+bool raw_file::write_out(const uint8_t* data, size_t size) {
+#ifdef _WIN32
+    if (fwrite(data, 1, size, (FILE*) m_file) != size)
+        return false;
+#else
+    while (size > 0) {
+        ssize_t n = ::write(m_fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        size -= (size_t) n;
+    }
+#endif
+    return true;
+}
+
+// writes out the whole blocks in the buffer, keeping the tail for later
+bool raw_file::flush_blocks() {
+    size_t size = m_used - m_used % BLOCK_SIZE;
+
+    if (size == 0)
+        return true;
+    if (!write_out(m_buffer, size))
+        return false;
+
+    memmove(m_buffer, m_buffer + size, m_used - size);
+    m_used -= size;
+    m_written += size;
+    return true;
+}
+
+bool raw_file::write(const void* data, size_t size) {
+    const uint8_t* src = (const uint8_t*) data;
+
+    while (size > 0) {
+        size_t n = BUFFER_SIZE - m_used;
+        if (n > size)
+            n = size;
+
+        memcpy(m_buffer + m_used, src, n);
+        m_used += n;
+        src += n;
+        size -= n;
+
+        if (m_used == BUFFER_SIZE && !flush_blocks())
+            return false;
+    }
+    return true;
+}
+
+bool raw_file::patch(uint64_t offset, const void* data, size_t size) {
+    // still in the buffer
+    if (offset >= m_written) {
+        if (offset + size > m_written + m_used)
+            return false;
+        memcpy(m_buffer + (offset - m_written), data, size);
+        return true;
+    }
+
+    if (offset + size > m_written)
+        return false;
+#ifdef _WIN32
+    FILE* file = (FILE*) m_file;
+    return _fseeki64(file, (int64_t) offset, SEEK_SET) == 0 && fwrite(data, 1, size, file) == size &&
+        _fseeki64(file, 0, SEEK_END) == 0;
+#else
+    // unaligned writes must go through the page cache
+    if (m_direct) {
+        int flags = fcntl(m_fd, F_GETFL);
+        if (flags == -1 || fcntl(m_fd, F_SETFL, flags & ~O_DIRECT) == -1)
+            return false;
+        m_direct = false;
+    }
+    return pwrite(m_fd, data, size, (off_t) offset) == (ssize_t) size;
+#endif
+}
+
+bool raw_file::close() {
+    bool ok = true;
+
+#ifdef _WIN32
+    if (m_file != nullptr) {
+        ok = write_out(m_buffer, m_used);
+        ok = fclose((FILE*) m_file) == 0 && ok;
+        m_file = nullptr;
+    }
+    _aligned_free(m_buffer);
+#else
+    if (m_fd >= 0) {
+        ok = flush_blocks();
+        // the tail isn't a whole block
+        if (ok && m_used > 0) {
+            int flags = fcntl(m_fd, F_GETFL);
+            ok = flags != -1 && (!m_direct || fcntl(m_fd, F_SETFL, flags & ~O_DIRECT) != -1) &&
+                write_out(m_buffer, m_used);
+        }
+        ok = ::close(m_fd) == 0 && ok;
+        m_fd = -1;
+    }
+    free(m_buffer);
+#endif
+
+    m_buffer  = nullptr;
+    m_written += m_used;
+    m_used    = 0;
+    m_direct  = false;
+    return ok;
+}
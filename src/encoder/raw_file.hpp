@@ -0,0 +1,70 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - raw_file.hpp                                            *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_ENCODER_RAW_FILE_HPP
+#define M64P_ENCODER_RAW_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/* Output file for uncompressed dumps. Data is gathered in a large aligned
+ * buffer and written out in whole blocks, so the file sees few, big,
+ * sequential writes. Where the OS allows it the file bypasses the page cache
+ * (O_DIRECT): a dump is written once and read much later, caching it would
+ * only evict useful data. */
+class raw_file {
+public:
+    raw_file() = default;
+    ~raw_file();
+
+    raw_file(const raw_file&)            = delete;
+    raw_file& operator=(const raw_file&) = delete;
+
+    bool open(const std::string& path);
+    bool write(const void* data, size_t size);
+    // rewrites bytes already written, used for headers that need the final sizes
+    bool patch(uint64_t offset, const void* data, size_t size);
+    bool close();
+
+    uint64_t size() const { return m_written + m_used; }
+    const std::string& path() const { return m_path; }
+
+private:
+    bool flush_blocks();
+    bool write_out(const uint8_t* data, size_t size);
+
+    static constexpr size_t BLOCK_SIZE  = 4096;
+    static constexpr size_t BUFFER_SIZE = 8 << 20;
+
+    std::string m_path;
+#ifdef _WIN32
+    void* m_file = nullptr;
+#else
+    int m_fd = -1;
+#endif
+    bool m_direct      = false;
+    uint8_t* m_buffer  = nullptr;
+    size_t m_used      = 0;
+    uint64_t m_written = 0;
+};
+
+#endif // M64P_ENCODER_RAW_FILE_HPP
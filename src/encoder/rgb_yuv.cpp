@@ -0,0 +1,276 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - rgb_yuv.cpp                                             *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "rgb_yuv.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define RGB_YUV_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define RGB_YUV_AVX2
+#else
+#define RGB_YUV_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// fixed point BT.601 coefficients, scaled by 256
+static inline uint8_t rgb_to_y(int r, int g, int b) {
+    return (uint8_t) (((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+static inline uint8_t rgb_to_u(int r, int g, int b) {
+    return (uint8_t) (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+
+static inline uint8_t rgb_to_v(int r, int g, int b) {
+    return (uint8_t) (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+// Converts two rows from column col on. The SIMD kernels below convert the
+// start of the rows and return where they stopped, this finishes the rest.
+typedef int (*row_pair_kernel)(
+    const uint8_t* top, const uint8_t* bottom, int width, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v
+);
+
+static void convert_rows(
+    const uint8_t* top, const uint8_t* bottom, int col, int width, uint8_t* y0, uint8_t* y1, uint8_t* u,
+    uint8_t* v
+) {
+    for (; col < width; col += 2) {
+        const uint8_t* a = top + col * 3;
+        const uint8_t* b = bottom + col * 3;
+
+        y0[col]     = rgb_to_y(a[0], a[1], a[2]);
+        y0[col + 1] = rgb_to_y(a[3], a[4], a[5]);
+        y1[col]     = rgb_to_y(b[0], b[1], b[2]);
+        y1[col + 1] = rgb_to_y(b[3], b[4], b[5]);
+
+        int cr     = (a[0] + a[3] + b[0] + b[3] + 2) >> 2;
+        int cg     = (a[1] + a[4] + b[1] + b[4] + 2) >> 2;
+        int cb     = (a[2] + a[5] + b[2] + b[5] + 2) >> 2;
+        u[col / 2] = rgb_to_u(cr, cg, cb);
+        v[col / 2] = rgb_to_v(cr, cg, cb);
+    }
+}
+
+#ifndef RGB_YUV_X86
+static int rows_scalar(const uint8_t*, const uint8_t*, int, uint8_t*, uint8_t*, uint8_t*, uint8_t*) {
+    return 0;
+}
+#else
+// Splits 16 packed RGB24 pixels into one register per channel. Each round
+// interleaves bytes that are 8 apart, four rounds gather the channels.
+static inline void deinterleave_rgb(const uint8_t* p, __m128i& r, __m128i& g, __m128i& b) {
+    __m128i t0 = _mm_loadu_si128((const __m128i*) p);
+    __m128i t1 = _mm_loadu_si128((const __m128i*) (p + 16));
+    __m128i t2 = _mm_loadu_si128((const __m128i*) (p + 32));
+
+    for (int i = 0; i < 4; ++i) {
+        __m128i u0 = _mm_unpacklo_epi8(t0, _mm_unpackhi_epi64(t1, t1));
+        __m128i u1 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t0, t0), t2);
+        __m128i u2 = _mm_unpacklo_epi8(t1, _mm_unpackhi_epi64(t2, t2));
+        t0         = u0;
+        t1         = u1;
+        t2         = u2;
+    }
+    r = t0;
+    g = t1;
+    b = t2;
+}
+
+// The formulas above on 16-bit lanes. Luma sums stay below 65536 and chroma
+// sums within int16, so the wrapping multiplies are exact.
+static inline __m128i luma_sse2(__m128i r, __m128i g, __m128i b) {
+    __m128i sum = _mm_add_epi16(
+        _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)), _mm_mullo_epi16(g, _mm_set1_epi16(129))),
+        _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(25)), _mm_set1_epi16(128))
+    );
+    return _mm_add_epi16(_mm_srli_epi16(sum, 8), _mm_set1_epi16(16));
+}
+
+static inline __m128i chroma_sse2(__m128i r, __m128i g, __m128i b, short kr, short kg, short kb) {
+    __m128i sum = _mm_add_epi16(
+        _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(kr)), _mm_mullo_epi16(g, _mm_set1_epi16(kg))),
+        _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(kb)), _mm_set1_epi16(128))
+    );
+    return _mm_add_epi16(_mm_srai_epi16(sum, 8), _mm_set1_epi16(128));
+}
+
+// rounded average of the 2x2 blocks, from the 16-bit sums of the two rows
+static inline __m128i average_pairs_sse2(__m128i lo, __m128i hi) {
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i two = _mm_set1_epi32(2);
+    lo                = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(lo, one), two), 2);
+    hi                = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(hi, one), two), 2);
+    return _mm_packs_epi32(lo, hi);
+}
+
+// SSE2 is part of x86-64, no check needed
+static int rows_sse2(
+    const uint8_t* top, const uint8_t* bottom, int width, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v
+) {
+    const __m128i zero = _mm_setzero_si128();
+    int col            = 0;
+
+    for (; col + 16 <= width; col += 16) {
+        __m128i c[2][3], lo[2][3], hi[2][3];
+
+        deinterleave_rgb(top + col * 3, c[0][0], c[0][1], c[0][2]);
+        deinterleave_rgb(bottom + col * 3, c[1][0], c[1][1], c[1][2]);
+        for (int row = 0; row < 2; ++row) {
+            for (int ch = 0; ch < 3; ++ch) {
+                lo[row][ch] = _mm_unpacklo_epi8(c[row][ch], zero);
+                hi[row][ch] = _mm_unpackhi_epi8(c[row][ch], zero);
+            }
+            __m128i luma = _mm_packus_epi16(
+                luma_sse2(lo[row][0], lo[row][1], lo[row][2]), luma_sse2(hi[row][0], hi[row][1], hi[row][2])
+            );
+            _mm_storeu_si128((__m128i*) ((row == 0 ? y0 : y1) + col), luma);
+        }
+
+        __m128i avg[3];
+        for (int ch = 0; ch < 3; ++ch)
+            avg[ch] = average_pairs_sse2(
+                _mm_add_epi16(lo[0][ch], lo[1][ch]), _mm_add_epi16(hi[0][ch], hi[1][ch])
+            );
+        __m128i uv = _mm_packus_epi16(
+            chroma_sse2(avg[0], avg[1], avg[2], -38, -74, 112), chroma_sse2(avg[0], avg[1], avg[2], 112, -94, -18)
+        );
+        _mm_storel_epi64((__m128i*) (u + col / 2), uv);
+        _mm_storel_epi64((__m128i*) (v + col / 2), _mm_unpackhi_epi64(uv, uv));
+    }
+    return col;
+}
+
+RGB_YUV_AVX2 static inline __m256i luma_avx2(__m256i r, __m256i g, __m256i b) {
+    __m256i sum = _mm256_add_epi16(
+        _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(66)), _mm256_mullo_epi16(g, _mm256_set1_epi16(129))),
+        _mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(25)), _mm256_set1_epi16(128))
+    );
+    return _mm256_add_epi16(_mm256_srli_epi16(sum, 8), _mm256_set1_epi16(16));
+}
+
+RGB_YUV_AVX2 static inline __m256i chroma_avx2(__m256i r, __m256i g, __m256i b, short kr, short kg, short kb) {
+    __m256i sum = _mm256_add_epi16(
+        _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(kr)), _mm256_mullo_epi16(g, _mm256_set1_epi16(kg))),
+        _mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(kb)), _mm256_set1_epi16(128))
+    );
+    return _mm256_add_epi16(_mm256_srai_epi16(sum, 8), _mm256_set1_epi16(128));
+}
+
+// the 256-bit packs work within 128-bit lanes, this puts the 64-bit quarters back in order
+RGB_YUV_AVX2 static inline __m256i unlane(__m256i packed) {
+    return _mm256_permute4x64_epi64(packed, 0xd8);
+}
+
+// 32 pixels at a time, the deinterleave stays on SSE2 as AVX2 shuffles can't cross lanes
+RGB_YUV_AVX2 static int rows_avx2(
+    const uint8_t* top, const uint8_t* bottom, int width, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v
+) {
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i two = _mm256_set1_epi32(2);
+    int col           = 0;
+
+    for (; col + 32 <= width; col += 32) {
+        __m128i c[2][3][2];
+        __m256i w[2][3][2];
+
+        for (int half = 0; half < 2; ++half) {
+            deinterleave_rgb(top + (col + half * 16) * 3, c[0][0][half], c[0][1][half], c[0][2][half]);
+            deinterleave_rgb(bottom + (col + half * 16) * 3, c[1][0][half], c[1][1][half], c[1][2][half]);
+        }
+        for (int row = 0; row < 2; ++row) {
+            for (int ch = 0; ch < 3; ++ch)
+                for (int half = 0; half < 2; ++half)
+                    w[row][ch][half] = _mm256_cvtepu8_epi16(c[row][ch][half]);
+            __m256i luma = unlane(_mm256_packus_epi16(
+                luma_avx2(w[row][0][0], w[row][1][0], w[row][2][0]),
+                luma_avx2(w[row][0][1], w[row][1][1], w[row][2][1])
+            ));
+            _mm256_storeu_si256((__m256i*) ((row == 0 ? y0 : y1) + col), luma);
+        }
+
+        __m256i avg[3];
+        for (int ch = 0; ch < 3; ++ch) {
+            __m256i pairs[2];
+            for (int half = 0; half < 2; ++half) {
+                __m256i sum = _mm256_add_epi16(w[0][ch][half], w[1][ch][half]);
+                pairs[half] = _mm256_srli_epi32(_mm256_add_epi32(_mm256_madd_epi16(sum, one), two), 2);
+            }
+            avg[ch] = unlane(_mm256_packs_epi32(pairs[0], pairs[1]));
+        }
+        __m256i uv = unlane(_mm256_packus_epi16(
+            chroma_avx2(avg[0], avg[1], avg[2], -38, -74, 112), chroma_avx2(avg[0], avg[1], avg[2], 112, -94, -18)
+        ));
+        _mm_storeu_si128((__m128i*) (u + col / 2), _mm256_castsi256_si128(uv));
+        _mm_storeu_si128((__m128i*) (v + col / 2), _mm256_extracti128_si256(uv, 1));
+    }
+    return col + rows_sse2(
+        top + col * 3, bottom + col * 3, width - col, y0 + col, y1 + col, u + col / 2, v + col / 2
+    );
+}
+
+static bool cpu_has_avx2() {
+#ifdef _MSC_VER
+    int info[4];
+
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    // the OS must also save the YMM registers
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+static row_pair_kernel select_kernel() {
+#ifdef RGB_YUV_X86
+    return cpu_has_avx2() ? rows_avx2 : rows_sse2;
+#else
+    return rows_scalar;
+#endif
+}
+
+void rgb24_to_yuv420(
+    const uint8_t* rgb, ptrdiff_t stride, int width, int height, uint8_t* y, ptrdiff_t y_stride,
+    uint8_t* u, uint8_t* v, ptrdiff_t uv_stride
+) {
+    static const row_pair_kernel kernel = select_kernel();
+
+    for (int row = 0; row < height; row += 2) {
+        const uint8_t* top    = rgb + row * stride;
+        const uint8_t* bottom = top + stride;
+        uint8_t* y0           = y + row * y_stride;
+        uint8_t* y1           = y0 + y_stride;
+        uint8_t* u_row        = u + row / 2 * uv_stride;
+        uint8_t* v_row        = v + row / 2 * uv_stride;
+
+        int col = kernel(top, bottom, width, y0, y1, u_row, v_row);
+        convert_rows(top, bottom, col, width, y0, y1, u_row, v_row);
+    }
+}
@@ -0,0 +1,38 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - rgb_yuv.hpp                                             *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_ENCODER_RGB_YUV_HPP
+#define M64P_ENCODER_RGB_YUV_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/* Converts RGB24 to planar YUV 4:2:0 (BT.601, limited range). Each chroma
+ * sample is taken from the average of a 2x2 block, width and height must be
+ * even. A negative stride walks the rows backwards, which flips the bottom-up
+ * frames the video plugins return. u and v share uv_stride.
+ * SSE2 or AVX2 is used when the CPU has it, the result is the same either way. */
+void rgb24_to_yuv420(
+    const uint8_t* rgb, ptrdiff_t stride, int width, int height, uint8_t* y, ptrdiff_t y_stride,
+    uint8_t* u, uint8_t* v, ptrdiff_t uv_stride
+);
+
+#endif // M64P_ENCODER_RGB_YUV_HPP
@@ -0,0 +1,96 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - spill_file.cpp                                          *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "spill_file.hpp"
+
+extern "C" {
+#include "osal/files.h"
+}
+
+spill_file::~spill_file() {
+    close();
+}
+
+bool spill_file::open(const std::string& path) {
+    m_writer = osal_file_open(path.c_str(), "wb");
+    if (m_writer == nullptr)
+        return false;
+    m_path   = path;
+    m_reader = osal_file_open(path.c_str(), "rb");
+    if (m_reader == nullptr) {
+        close();
+        return false;
+    }
+    m_read.store(0, std::memory_order_relaxed);
+    m_written.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+void spill_file::close() {
+    if (m_reader != nullptr)
+        fclose(m_reader);
+    if (m_writer != nullptr)
+        fclose(m_writer);
+    m_reader = m_writer = nullptr;
+    // only once both handles are closed, Windows can't delete a file that is still open
+    if (!m_path.empty()) {
+        unlink(m_path.c_str());
+        m_path.clear();
+    }
+}
+
+bool spill_file::push(const enc_video_frame& frame, unsigned int repeat) {
+    header hdr {frame.width, frame.height, repeat};
+    size_t size = (size_t) frame.width * frame.height * 3;
+
+    if (fwrite(&hdr, sizeof(hdr), 1, m_writer) != 1 || fwrite(frame.pixels, 1, size, m_writer) != size ||
+        fflush(m_writer) != 0) {
+        // a partial frame would shift every later one, stop writing to the file.
+        // The frames before it can still be read, it is deleted by close()
+        fclose(m_writer);
+        m_writer = nullptr;
+        return false;
+    }
+    m_written.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+bool spill_file::pop(enc_video_frame& frame, unsigned int& repeat, std::vector<uint8_t>& storage) {
+    header hdr;
+
+    // the count also publishes m_reader, set before the first frame
+    if (size() == 0)
+        return false;
+
+    clearerr(m_reader);
+    if (fread(&hdr, sizeof(hdr), 1, m_reader) != 1)
+        return false;
+    storage.resize((size_t) hdr.width * hdr.height * 3);
+    if (fread(storage.data(), 1, storage.size(), m_reader) != storage.size())
+        return false;
+    m_read.fetch_add(1, std::memory_order_release);
+
+    frame.width  = hdr.width;
+    frame.height = hdr.height;
+    frame.pixels = storage.data();
+    repeat       = hdr.repeat;
+    return true;
+}
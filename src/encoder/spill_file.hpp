@@ -0,0 +1,74 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - spill_file.hpp                                          *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_ENCODER_SPILL_FILE_HPP
+#define M64P_ENCODER_SPILL_FILE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "encoder_backend.hpp"
+
+/* Unbounded frame FIFO on disk, for when the encoder falls behind and frames
+ * must neither be dropped nor slow down emulation. Like spsc_queue it has one
+ * producer and one consumer thread; each side has its own handle on the file,
+ * a frame is only counted once it has been flushed to it. The file only grows
+ * and is deleted on close, after both handles are closed. */
+class spill_file {
+public:
+    spill_file() = default;
+    ~spill_file();
+
+    spill_file(const spill_file&)            = delete;
+    spill_file& operator=(const spill_file&) = delete;
+
+    bool open(const std::string& path);
+    bool is_open() const { return m_writer != nullptr; }
+    void close();
+
+    // producer side, repeat is passed back along with the frame
+    bool push(const enc_video_frame& frame, unsigned int repeat);
+    // consumer side, the pixels are read into storage
+    bool pop(enc_video_frame& frame, unsigned int& repeat, std::vector<uint8_t>& storage);
+
+    size_t size() const {
+        size_t read = m_read.load(std::memory_order_acquire);  // see spsc_queue::size
+        return m_written.load(std::memory_order_acquire) - read;
+    }
+
+private:
+    struct header {
+        int32_t width;
+        int32_t height;
+        uint32_t repeat;
+    };
+
+    std::string m_path;
+    FILE* m_writer = nullptr;
+    FILE* m_reader = nullptr;
+    alignas(64) std::atomic<size_t> m_read {0};
+    alignas(64) std::atomic<size_t> m_written {0};
+};
+
+#endif // M64P_ENCODER_SPILL_FILE_HPP
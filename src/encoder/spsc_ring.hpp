@@ -0,0 +1,112 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - spsc_ring.hpp                                           *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_ENCODER_SPSC_RING_HPP
+#define M64P_ENCODER_SPSC_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/* Byte ring between exactly one producer thread and one consumer thread,
+ * carrying variable-sized records tagged with a small type. Records are
+ * written whole or not at all: when the ring is full the producer's record is
+ * refused instead of waiting for the consumer, and the consumer never sees a
+ * torn one. */
+template <size_t N>
+class spsc_ring {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "spsc_ring capacity must be a power of two");
+
+    struct header {
+        uint32_t tag;
+        uint32_t size;
+    };
+
+public:
+    // producer side
+    bool try_write(uint32_t tag, const void* data, size_t size) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        header hdr {tag, (uint32_t) size};
+
+        if (sizeof(hdr) + size > N - (tail - m_head.load(std::memory_order_acquire)))
+            return false;
+
+        copy_in(tail, &hdr, sizeof(hdr));
+        copy_in(tail + sizeof(hdr), data, size);
+        m_tail.store(tail + sizeof(hdr) + size, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, the payload of the next record replaces the content of out
+    bool try_read(uint32_t& tag, std::vector<uint8_t>& out) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        header hdr;
+
+        if (head == m_tail.load(std::memory_order_acquire))
+            return false;
+
+        copy_out(head, &hdr, sizeof(hdr));
+        out.resize(hdr.size);
+        copy_out(head + sizeof(hdr), out.data(), hdr.size);
+        m_head.store(head + sizeof(hdr) + hdr.size, std::memory_order_release);
+
+        tag = hdr.tag;
+        return true;
+    }
+
+    // consumer side, drops everything written so far
+    void clear() { m_head.store(m_tail.load(std::memory_order_acquire), std::memory_order_release); }
+
+    // bytes in use, including record headers
+    size_t size() const {
+        // head first: tail can only have moved further since, so this never underflows
+        size_t head = m_head.load(std::memory_order_acquire);
+        return m_tail.load(std::memory_order_acquire) - head;
+    }
+
+    static constexpr size_t capacity() { return N; }
+
+private:
+    // positions grow forever, only their low bits index the ring
+    void copy_in(size_t pos, const void* src, size_t size) {
+        size_t offset = pos & (N - 1);
+        size_t first  = (size < N - offset) ? size : N - offset;
+
+        memcpy(m_data + offset, src, first);
+        memcpy(m_data, (const uint8_t*) src + first, size - first);
+    }
+
+    void copy_out(size_t pos, void* dst, size_t size) const {
+        size_t offset = pos & (N - 1);
+        size_t first  = (size < N - offset) ? size : N - offset;
+
+        memcpy(dst, m_data + offset, first);
+        memcpy((uint8_t*) dst + first, m_data, size - first);
+    }
+
+    uint8_t m_data[N];
+    alignas(64) std::atomic<size_t> m_head{0};
+    alignas(64) std::atomic<size_t> m_tail{0};
+};
+
+#endif // M64P_ENCODER_SPSC_RING_HPP
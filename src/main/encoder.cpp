@@ -1,28 +1,85 @@
 #include "encoder.h"
 #include <stdbool.h>
-#include <any>
-#include <future>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
 #include <shared_mutex>
-#include <stdexcept>
-#include <system_error>
+#include <string>
 #include <thread>
-#include <unordered_map>
+#include <vector>
 #define M64P_CORE_PROTOTYPES
 #define M64P_ENCODER_PROTOTYPES
 #include <mutex>
 extern "C" {
+#include "api/callbacks.h"
+#include "api/m64p_config.h"
 #include "api/m64p_encoder.h"
 #include "api/m64p_types.h"
 #include "main.h"  //for sample rate
+#include "frame_pool.h"
+#include "osal/preproc.h"
 }
+#include "encoder/encoder_backend.hpp"
+#include "encoder/raw_encoder.hpp"
+#include "encoder/spill_file.hpp"
+#include "encoder/spsc_queue.hpp"
+#include "encoder/spsc_ring.hpp"
+#ifdef M64P_FFMPEG
+#include "encoder/ffm_encoder.hpp"
+#endif
 
 static bool g_encoder_active = false;
 // shared_mutex is really a read/write lock.
 // - the read lock is the shared lock
 // - the write lock is the exclusive lock
+// The emulation thread only ever tries the read lock: while Encoder_Start/Stop
+// hold the write lock, its frames are dropped rather than waited for.
 static std::shared_mutex enc_rwlock;
 
-static std::unordered_map<std::string, std::string> format_opts;
+// The emulation thread hands frames and audio to the encoder thread through
+// these queues. What happens when they are full depends on enc_policy.
+// AI DMA buffers are copied straight into the audio ring, with the sample rate
+// changes and the gaps left by dropped buffers recorded in between.
+// Each queued frame carries the number of frames dropped just before it, the
+// encoder thread repeats the previous frame that many times.
+enum { enc_record_samples, enc_record_rate, enc_record_gap };
+struct enc_queued_frame {
+    frame_buffer* buffer = NULL;
+    unsigned int repeat  = 0;
+};
+static spsc_queue<enc_queued_frame, 16> enc_video_queue;
+static spsc_ring<1 << 20> enc_audio_ring;
+static spill_file enc_spill;
+static std::string enc_spill_path;
+static m64p_encoder_backpressure enc_policy = M64ENC_DROP;
+static bool enc_video                       = true;  // false for audio-only captures
+static std::unique_ptr<encoder_backend> enc_backend;
+static std::thread enc_thread;
+static std::atomic<uint32_t> enc_wake {0};
+static std::atomic<uint32_t> enc_room {0};  // bumped whenever the encoder thread frees some space
+static std::atomic<bool> enc_stop {false};
+static std::atomic<bool> enc_discard {false};
+
+// emulation thread only
+static unsigned int enc_pending_rate = 0;
+static uint64_t enc_pending_gap      = 0;
+static unsigned int enc_skipped      = 0;
+static bool enc_warned               = false;
+static bool enc_spill_failed         = false;
+
+// see Encoder_GetStats
+static std::atomic<uint64_t> enc_frames_encoded {0};
+static std::atomic<uint64_t> enc_frames_dropped {0};
+static std::atomic<uint64_t> enc_frames_spilled {0};
+static std::atomic<uint64_t> enc_audio_dropped {0};
+static std::atomic<uint64_t> enc_stall_us {0};
+
+// encoder thread only: the last frame, kept for repeats
+static frame_buffer* enc_last_buffer = NULL;
+static enc_video_frame enc_last_frame;
+static std::vector<uint8_t> enc_spill_pixels[2];
+static int enc_spill_index = 0;
 
 // Audio stuff
 m64p_sample_callback* g_sample_callback            = NULL;
@@ -40,20 +97,322 @@ EXPORT m64p_error CALL Encoder_SetRateChangedCallback(m64p_rate_changed_callback
 EXPORT unsigned int CALL Encoder_GetSampleRate(void) {
     // dacrate = ai->vi->clock / frequency - 1
     // ai->vi->clock/(dacrate+1) = frequency
+    if (g_dev.ai.regs[AI_DACRATE_REG] == 0)
+        return 44100;
     return (unsigned int) g_dev.ai.vi->clock /
         (g_dev.ai.regs[AI_DACRATE_REG] + 1);
 }
 
 // Audio end
+
+static void encoder_wake() {
+    enc_wake.fetch_add(1, std::memory_order_release);
+    enc_wake.notify_one();
+}
+
+static void encoder_made_room() {
+    enc_room.fetch_add(1, std::memory_order_release);
+    enc_room.notify_one();
+}
+
+// buffer is the frame_buffer behind frame if any, its reference is taken over
+static void encoder_video(const enc_video_frame& frame, unsigned int repeat, frame_buffer* buffer) {
+    for (unsigned int i = 0; i < repeat && enc_last_frame.pixels != NULL; ++i) {
+        enc_backend->push_video(enc_last_frame);
+        enc_frames_encoded.fetch_add(1, std::memory_order_relaxed);
+    }
+    enc_backend->push_video(frame);
+    enc_frames_encoded.fetch_add(1, std::memory_order_relaxed);
+
+    if (enc_last_buffer != NULL)
+        frame_buffer_unref(enc_last_buffer);
+    enc_last_buffer = buffer;
+    enc_last_frame  = frame;
+}
+
+static void encoder_loop() {
+    enc_queued_frame queued;
+    enc_video_frame frame;
+    enc_audio_chunk chunk;
+    std::vector<uint8_t> record;
+    std::vector<uint8_t> silence;
+    unsigned int repeat;
+    uint32_t tag;
+
+    for (;;) {
+        uint32_t wake = enc_wake.load(std::memory_order_acquire);
+        bool idle     = true;
+
+        if (enc_stop.load(std::memory_order_acquire) && enc_discard.load(std::memory_order_relaxed))
+            break;
+
+        // audio comes in small chunks, take all of it before the next frame
+        while (enc_audio_ring.try_read(tag, record)) {
+            encoder_made_room();
+            idle = false;
+            if (tag == enc_record_rate) {
+                memcpy(&chunk.sample_rate, record.data(), sizeof(chunk.sample_rate));
+                if (g_rate_changed_callback != NULL)
+                    g_rate_changed_callback(chunk.sample_rate);
+                continue;
+            }
+            if (tag == enc_record_gap) {
+                uint64_t gap;
+                memcpy(&gap, record.data(), sizeof(gap));
+                silence.assign((size_t) gap, 0);
+                chunk.samples = silence.data();
+                chunk.size    = silence.size();
+            }
+            else {
+                chunk.samples = record.data();
+                chunk.size    = record.size();
+            }
+            enc_backend->push_audio(chunk);
+            if (g_sample_callback != NULL)
+                g_sample_callback(chunk.samples, chunk.size);
+        }
+
+        // frames only go to the spill file once the queue is full, so the queue holds the older ones
+        if (enc_video_queue.try_pop(queued)) {
+            encoder_made_room();
+            frame.width  = queued.buffer->width;
+            frame.height = queued.buffer->height;
+            frame.pixels = queued.buffer->pixels;
+            encoder_video(frame, queued.repeat, queued.buffer);
+            idle = false;
+        }
+        else if (enc_spill.pop(frame, repeat, enc_spill_pixels[enc_spill_index])) {
+            // the other buffer still holds the last frame
+            enc_spill_index ^= 1;
+            encoder_video(frame, repeat, NULL);
+            idle = false;
+        }
+
+        if (idle) {
+            if (enc_stop.load(std::memory_order_acquire))
+                break;
+            enc_wake.wait(wake, std::memory_order_acquire);
+        }
+    }
+}
+
+// Runs attempt until it succeeds. If wait is set, emulation waits for the
+// encoder thread to make room in between, otherwise it gives up right away.
+template <class F>
+static bool encoder_retry(bool wait, F attempt) {
+    if (attempt())
+        return true;
+    if (!wait)
+        return false;
+
+    auto start = std::chrono::steady_clock::now();
+    for (;;) {
+        uint32_t room = enc_room.load(std::memory_order_acquire);
+        if (attempt())
+            break;
+        enc_room.wait(room, std::memory_order_acquire);
+    }
+    auto stall = std::chrono::steady_clock::now() - start;
+    enc_stall_us.fetch_add(
+        std::chrono::duration_cast<std::chrono::microseconds>(stall).count(), std::memory_order_relaxed
+    );
+    return true;
+}
+
+static void encoder_warn_once() {
+    // once per capture is enough to tell the encoder can't keep up
+    if (!enc_warned)
+        DebugMessage(M64MSG_WARNING, "Encoder: can't keep up with emulation, dropping data");
+    enc_warned = true;
+}
+
+static void encoder_drop_frame() {
+    ++enc_skipped;
+    enc_frames_dropped.fetch_add(1, std::memory_order_relaxed);
+    encoder_warn_once();
+}
+
+static bool encoder_spill(frame_buffer* frame) {
+    enc_video_frame spilled;
+
+    // after a failure frames are dropped instead, as in M64ENC_DROP
+    if (enc_spill_failed)
+        return false;
+    if (!enc_spill.is_open() && !enc_spill.open(enc_spill_path)) {
+        DebugMessage(M64MSG_WARNING, "Encoder: couldn't open '%s' to spill frames", enc_spill_path.c_str());
+        enc_spill_failed = true;
+        return false;
+    }
+
+    spilled.width  = frame->width;
+    spilled.height = frame->height;
+    spilled.pixels = frame->pixels;
+    if (!enc_spill.push(spilled, enc_skipped)) {
+        DebugMessage(M64MSG_WARNING, "Encoder: couldn't write to '%s'", enc_spill_path.c_str());
+        enc_spill_failed = true;
+        return false;
+    }
+    enc_frames_spilled.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+extern "C" void encoder_push_video() {
+    std::shared_lock lock(enc_rwlock, std::try_to_lock);
+    enc_queued_frame queued;
+
+    // the screen isn't updated while replaying to a seek target
+    if (!lock.owns_lock() || !g_encoder_active || !enc_video || main_is_replaying())
+        return;
+
+    // only M64ENC_BLOCK waits for room, M64ENC_SPILL spills as soon as the queue is full,
+    // and frames keep going to the spill file until the encoder has read them all
+    bool full = !encoder_retry(enc_policy == M64ENC_BLOCK, [] {
+        return enc_video_queue.size() < enc_video_queue.capacity();
+    });
+    bool spill = enc_policy == M64ENC_SPILL && (full || enc_spill.size() > 0);
+    if (full && !spill) {
+        encoder_drop_frame();
+        return;
+    }
+
+    if ((queued.buffer = frame_pool_grab(1)) == NULL) {
+        encoder_drop_frame();
+        return;
+    }
+
+    if (spill) {
+        bool spilled = encoder_spill(queued.buffer);
+        frame_buffer_unref(queued.buffer);
+        if (!spilled) {
+            encoder_drop_frame();
+            return;
+        }
+    }
+    else {
+        queued.repeat = enc_skipped;
+        enc_video_queue.try_push(std::move(queued));
+    }
+    enc_skipped = 0;
+    encoder_wake();
+}
+
+// rate changes and gaps that didn't fit in the ring are retried before the next samples
+static bool encoder_flush_pending() {
+    if (enc_pending_rate != 0) {
+        if (!enc_audio_ring.try_write(enc_record_rate, &enc_pending_rate, sizeof(enc_pending_rate)))
+            return false;
+        enc_pending_rate = 0;
+    }
+    if (enc_pending_gap != 0) {
+        if (!enc_audio_ring.try_write(enc_record_gap, &enc_pending_gap, sizeof(enc_pending_gap)))
+            return false;
+        enc_pending_gap = 0;
+    }
+    return true;
+}
+
+extern "C" void encoder_push_audio(const void* buffer, size_t size) {
+    std::shared_lock lock(enc_rwlock, std::try_to_lock);
+
+    if (!lock.owns_lock() || !g_encoder_active || main_is_replaying() || size == 0)
+        return;
+
+    // a buffer that could never fit isn't worth waiting for
+    if (size > enc_audio_ring.capacity() / 2 ||
+        !encoder_retry(enc_policy != M64ENC_DROP, [&] {
+            return encoder_flush_pending() && enc_audio_ring.try_write(enc_record_samples, buffer, size);
+        })) {
+        enc_pending_gap += size;
+        enc_audio_dropped.fetch_add(size, std::memory_order_relaxed);
+        encoder_warn_once();
+        return;
+    }
+    encoder_wake();
+}
+
+extern "C" void encoder_set_sample_rate(unsigned int rate) {
+    std::shared_lock lock(enc_rwlock, std::try_to_lock);
+
+    if (!lock.owns_lock() || !g_encoder_active)
+        return;
+
+    enc_pending_rate = rate;
+    if (encoder_flush_pending())
+        encoder_wake();
+}
+
 EXPORT bool CALL Encoder_IsActive() {
     // return ffm_encoder != NULL; //old encoder
     return g_encoder_active;
 }
 
+// The raw dumps are picked by name, everything else goes to FFmpeg.
+// Returns 0 for FFmpeg, 1 for a Y4M/WAV dump and 2 for a WAV file alone.
+static int encoder_raw_kind(const char* path, const char* format) {
+    if (format == NULL) {
+        const char* dot = strrchr(path, '.');
+        format          = dot != NULL ? dot + 1 : "";
+    }
+    if (osal_insensitive_strcmp(format, "y4m") == 0)
+        return 1;
+    if (osal_insensitive_strcmp(format, "wav") == 0)
+        return 2;
+    return 0;
+}
+
 EXPORT m64p_error CALL Encoder_Start(const char* path, const char* format) {
     std::unique_lock _lock(enc_rwlock);
     if (g_encoder_active)
         return M64ERR_ALREADY_INIT;
+    if (path == NULL)
+        return M64ERR_INPUT_ASSERT;
+    // the frame rate and sample rate come from the running ROM
+    if (!g_EmulatorRunning)
+        return M64ERR_INVALID_STATE;
+
+    if (int kind = encoder_raw_kind(path, format)) {
+        auto backend   = std::make_unique<raw_encoder>();
+        m64p_error err = backend->open(
+            path, g_dev.vi.expected_refresh_rate, Encoder_GetSampleRate(), kind == 1
+        );
+        if (err != M64ERR_SUCCESS)
+            return err;
+        enc_backend = std::move(backend);
+    }
+    else {
+#ifdef M64P_FFMPEG
+        auto backend = std::make_unique<ffm_encoder>();
+        m64p_error err =
+            backend->open(path, format, g_dev.vi.expected_refresh_rate, Encoder_GetSampleRate());
+        if (err != M64ERR_SUCCESS)
+            return err;
+        enc_backend = std::move(backend);
+#else
+        DebugMessage(M64MSG_ERROR, "Encoder: this build has no FFmpeg support, only y4m and wav are available");
+        return M64ERR_UNSUPPORTED;
+#endif
+    }
+
+    enc_policy = (m64p_encoder_backpressure) ConfigGetParamInt(g_CoreConfig, "EncoderBackpressure");
+    if (enc_policy < M64ENC_DROP || enc_policy > M64ENC_SPILL)
+        enc_policy = M64ENC_DROP;
+    enc_spill_path = std::string(path) + ".spill";
+    enc_video      = enc_backend->wants_video();
+
+    enc_stop           = false;
+    enc_discard        = false;
+    enc_pending_rate   = Encoder_GetSampleRate();
+    enc_pending_gap    = 0;
+    enc_skipped        = 0;
+    enc_warned         = false;
+    enc_spill_failed   = false;
+    enc_frames_encoded = 0;
+    enc_frames_dropped = 0;
+    enc_frames_spilled = 0;
+    enc_audio_dropped  = 0;
+    enc_stall_us       = 0;
+    enc_thread         = std::thread(encoder_loop);
+
     g_encoder_active = true;
     return M64ERR_SUCCESS;
 }
@@ -62,12 +421,58 @@ EXPORT m64p_error CALL Encoder_Stop(bool discard) {
     std::unique_lock _lock(enc_rwlock);
     if (!g_encoder_active)
         return M64ERR_NOT_INIT;
+    g_encoder_active = false;
+
+    // the encoder thread exits once it has emptied the queues, right away on discard
+    enc_discard.store(discard, std::memory_order_relaxed);
+    enc_stop.store(true, std::memory_order_release);
+    encoder_wake();
+    enc_thread.join();
+
+    // frames dropped at the very end still take their time in the output
+    if (!discard && enc_skipped > 0 && enc_last_frame.pixels != NULL)
+        encoder_video(enc_last_frame, enc_skipped - 1, NULL);
+    if (enc_last_buffer != NULL)
+        frame_buffer_unref(enc_last_buffer);
+    enc_last_buffer       = NULL;
+    enc_last_frame.pixels = NULL;
+
+    enc_queued_frame queued;
+    while (enc_video_queue.try_pop(queued))
+        frame_buffer_unref(queued.buffer);
+    enc_audio_ring.clear();
+    enc_spill.close();
+
+    if (enc_frames_dropped > 0 || enc_audio_dropped > 0)
+        DebugMessage(
+            M64MSG_WARNING, "Encoder: %llu frames and %llu bytes of audio were dropped",
+            (unsigned long long) enc_frames_dropped, (unsigned long long) enc_audio_dropped
+        );
+
+    bool ok = enc_backend->finish(discard);
+    enc_backend.reset();
+    return ok ? M64ERR_SUCCESS : M64ERR_SYSTEM_FAIL;
+}
+
+EXPORT m64p_error CALL Encoder_GetStats(m64p_encoder_stats* stats) {
+    if (stats == NULL)
+        return M64ERR_INPUT_ASSERT;
+
+    stats->video_queued   = (unsigned int) enc_video_queue.size();
+    stats->video_spilled  = (unsigned int) enc_spill.size();
+    stats->audio_queued   = (unsigned int) enc_audio_ring.size();
+    stats->frames_encoded = enc_frames_encoded.load(std::memory_order_relaxed);
+    stats->frames_dropped = enc_frames_dropped.load(std::memory_order_relaxed);
+    stats->frames_spilled = enc_frames_spilled.load(std::memory_order_relaxed);
+    stats->audio_dropped  = enc_audio_dropped.load(std::memory_order_relaxed);
+    stats->stall_us       = enc_stall_us.load(std::memory_order_relaxed);
     return M64ERR_SUCCESS;
 }
 
 extern "C" void encoder_startup() {}
 
 extern "C" void encoder_shutdown() {
-    std::unique_lock _lock(enc_rwlock);
-    g_encoder_active = false;
-}
\ No newline at end of file
+    // finish the capture rather than losing it
+    if (Encoder_IsActive())
+        Encoder_Stop(false);
+}
@@ -10,6 +10,11 @@ extern "C" {
 extern void encoder_startup();
 extern void encoder_shutdown();
 
+// called by the emulation thread, never block: data is dropped if the encoder lags behind
+extern void encoder_push_video();
+extern void encoder_push_audio(const void* buffer, size_t size);
+extern void encoder_set_sample_rate(unsigned int rate);
+
 // Audio stuff
 extern m64p_sample_callback* g_sample_callback;
 extern m64p_rate_changed_callback* g_rate_changed_callback;
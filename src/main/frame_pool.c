@@ -0,0 +1,122 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - frame_pool.c                                            *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* The screen size is queried before every grab: video plugins may resize their
+ * output at any time, and ReadScreen2 writes without knowing the buffer size.
+ * The buffer itself is one that was used before, unless the screen grew. */
+
+#include "frame_pool.h"
+
+#include <stdlib.h>
+
+#include "api/callbacks.h"
+#include "api/m64p_types.h"
+#include "plugin/plugin.h"
+
+static SDL_SpinLock l_lock = 0;
+static struct frame_buffer *l_free = NULL;
+
+static struct frame_buffer *frame_pool_pop(void)
+{
+    struct frame_buffer *frame;
+
+    SDL_AtomicLock(&l_lock);
+    frame = l_free;
+    if (frame != NULL)
+        l_free = frame->next;
+    SDL_AtomicUnlock(&l_lock);
+
+    if (frame == NULL)
+        frame = calloc(1, sizeof(*frame));
+    return frame;
+}
+
+static void frame_pool_push(struct frame_buffer *frame)
+{
+    SDL_AtomicLock(&l_lock);
+    frame->next = l_free;
+    l_free = frame;
+    SDL_AtomicUnlock(&l_lock);
+}
+
+struct frame_buffer *frame_pool_grab(int front)
+{
+    struct frame_buffer *frame;
+    int width = 0, height = 0;
+    size_t size;
+
+    gfx.readScreen(NULL, &width, &height, front);
+    if (width <= 0 || height <= 0)
+        return NULL;
+
+    frame = frame_pool_pop();
+    if (frame == NULL)
+        return NULL;
+
+    size = (size_t)width * height * 3;
+    if (frame->capacity < size)
+    {
+        unsigned char *pixels = realloc(frame->pixels, size);
+        if (pixels == NULL)
+        {
+            frame_pool_push(frame);
+            return NULL;
+        }
+        frame->pixels = pixels;
+        frame->capacity = size;
+    }
+
+    frame->width = width;
+    frame->height = height;
+    gfx.readScreen(frame->pixels, &frame->width, &frame->height, front);
+
+    SDL_AtomicSet(&frame->refs, 1);
+    return frame;
+}
+
+void frame_buffer_ref(struct frame_buffer *frame)
+{
+    SDL_AtomicIncRef(&frame->refs);
+}
+
+void frame_buffer_unref(struct frame_buffer *frame)
+{
+    if (frame != NULL && SDL_AtomicDecRef(&frame->refs))
+        frame_pool_push(frame);
+}
+
+void frame_pool_release(void)
+{
+    struct frame_buffer *frame;
+
+    SDL_AtomicLock(&l_lock);
+    frame = l_free;
+    l_free = NULL;
+    SDL_AtomicUnlock(&l_lock);
+
+    while (frame != NULL)
+    {
+        struct frame_buffer *next = frame->next;
+        free(frame->pixels);
+        free(frame);
+        frame = next;
+    }
+}
@@ -0,0 +1,52 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - frame_pool.h                                            *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef M64P_MAIN_FRAME_POOL_H
+#define M64P_MAIN_FRAME_POOL_H
+
+#include <SDL.h>
+#include <stddef.h>
+
+/* A screen grab, as the video plugin's ReadScreen2 returns it: RGB24, bottom
+ * row first. Grabs are reference counted so that several consumers (encoder,
+ * screenshots) can hold on to the same pixels, the buffer goes back to the
+ * pool when the last of them lets go. */
+struct frame_buffer
+{
+    int width;
+    int height;
+    unsigned char *pixels;
+    size_t capacity;
+    SDL_atomic_t refs;
+    struct frame_buffer *next;
+};
+
+/* grabs the front or back buffer into a recycled frame, returned with one reference.
+ * Must be called from the emulation thread. */
+struct frame_buffer *frame_pool_grab(int front);
+
+void frame_buffer_ref(struct frame_buffer *frame);
+void frame_buffer_unref(struct frame_buffer *frame);
+
+/* frees the frames nobody is using */
+void frame_pool_release(void);
+
+#endif /* M64P_MAIN_FRAME_POOL_H */
@@ -40,6 +40,7 @@
 #define M64P_CORE_PROTOTYPES 1
 #ifdef VCR_SUPPORT
 #include "VCR/VCR.h"
+#include "VCR/greenzone.h"
 #include "api/m64p_vcr.h"
 #endif
 
@@ -72,6 +73,7 @@
 #include "device/pif/bootrom_hle.h"
 #include "eventloop.h"
 #include "encoder.h"
+#include "frame_pool.h"
 #include "main.h"
 #include "osal/files.h"
 #include "osal/preproc.h"
@@ -80,6 +82,7 @@
 #if defined(PROFILE)
 #include "profile.h"
 #endif
+#include "rewind.h"
 #include "rom.h"
 #include "savestates.h"
 #include "screenshot.h"
@@ -127,6 +130,7 @@ int g_gs_vi_counter = 0;
 /** static (local) variables **/
 static int   l_CurrentFrame = 0;         // frame counter
 static int   l_TakeScreenshot = 0;       // Tell OSD Rendering callback to take a screenshot just before drawing the OSD
+static int   l_ScreenshotInterval = 0;   // Take a screenshot every that many frames, 0 to only take them on request
 static int   l_SpeedFactor = 100;        // percentage of nominal game speed at which emulator is running
 static int   l_FrameAdvance = 0;         // variable to check if we pause on next frame
 static int   l_MainSpeedLimit = 1;       // insert delay during vi_interrupt to keep speed at real-time
@@ -426,18 +430,34 @@ int main_set_core_defaults(void)
     ConfigSetDefaultFloat(g_CoreConfig, "Version", (float) CONFIG_PARAM_VERSION,  "Mupen64Plus Core config parameter set version number.  Please don't change this version number.");
     ConfigSetDefaultBool(g_CoreConfig, "OnScreenDisplay", 1, "Draw on-screen display if True, otherwise don't draw OSD");
 #if defined(DYNAREC)
-    ConfigSetDefaultInt(g_CoreConfig, "R4300Emulator", 2, "Use Pure Interpreter if 0, Cached Interpreter if 1, or Dynamic Recompiler if 2 or more");
+    ConfigSetDefaultInt(g_CoreConfig, "R4300Emulator", 2, "Use Pure Interpreter if 0, Cached Interpreter if 1, Dynamic Recompiler if 2, or Dynamic Recompiler only for hot code if 3");
 #else
-    ConfigSetDefaultInt(g_CoreConfig, "R4300Emulator", 1, "Use Pure Interpreter if 0, Cached Interpreter if 1, or Dynamic Recompiler if 2 or more");
+    ConfigSetDefaultInt(g_CoreConfig, "R4300Emulator", 1, "Use Pure Interpreter if 0, Cached Interpreter if 1, Dynamic Recompiler if 2, or Dynamic Recompiler only for hot code if 3");
 #endif
     ConfigSetDefaultBool(g_CoreConfig, "NoCompiledJump", 0, "Disable compiled jump commands in dynamic recompiler (should be set to False) ");
+    ConfigSetDefaultInt(g_CoreConfig, "DynarecTierThreshold", 4096, "Number of instructions of a 4KB page interpreted before it gets recompiled, when R4300Emulator is 3");
     ConfigSetDefaultBool(g_CoreConfig, "DisableExtraMem", 0, "Disable 4MB expansion RAM pack. May be necessary for some games");
     ConfigSetDefaultInt(g_CoreConfig, "CountPerOp", 0, "Force number of cycles per emulated instruction");
     ConfigSetDefaultInt(g_CoreConfig, "CountPerOpDenomPot", 0, "Reduce number of cycles per update by power of two when set greater than 0 (overclock)");
     ConfigSetDefaultBool(g_CoreConfig, "AutoStateSlotIncrement", 0, "Increment the save state slot after each save operation");
     ConfigSetDefaultInt(g_CoreConfig, "CurrentStateSlot", 0, "Save state slot (0-9) to use when saving/loading the emulator state");
+    ConfigSetDefaultInt(g_CoreConfig, "SaveStateCompression", SAVESTATES_COMPRESSION_PARALLEL, "Save state compression (0: None, 1: Fast deflate, 2: Deflate split over several threads)");
+    ConfigSetDefaultBool(g_CoreConfig, "SaveStatePrefetch", 0, "Keep the selected save state slot and its neighbours decompressed in memory for faster loading");
+#ifdef VCR_SUPPORT
+    ConfigSetDefaultBool(g_CoreConfig, "SaveStateMovieDelta", 0, "Movie save states only store the inputs that differ from the movie as it was started");
+#endif
+    ConfigSetDefaultInt(g_CoreConfig, "RewindBufferSize", 0, "Memory (in MB) used to keep rewind history, 0 disables rewind");
+    ConfigSetDefaultInt(g_CoreConfig, "RewindInterval", 6, "Number of frames (VIs) between two rewind snapshots");
+#ifdef VCR_SUPPORT
+    ConfigSetDefaultInt(g_CoreConfig, "GreenzoneBufferSize", 0, "Memory (in MB) used to keep movie checkpoints for seeking, 0 disables them");
+    ConfigSetDefaultInt(g_CoreConfig, "GreenzoneInterval", 10, "Number of movie frames between two checkpoints around the current frame");
+#endif
     ConfigSetDefaultBool(g_CoreConfig, "EnableDebugger", 0, "Activate the R4300 debugger when ROM execution begins, if core was built with Debugger support");
     ConfigSetDefaultString(g_CoreConfig, "ScreenshotPath", "", "Path to directory where screenshots are saved. If this is blank, the default value of ${UserDataPath}/screenshot will be used");
+    ConfigSetDefaultInt(g_CoreConfig, "ScreenshotInterval", 0, "Take a screenshot every that many frames, 0 disables burst screenshots");
+#ifdef ENC_SUPPORT
+    ConfigSetDefaultInt(g_CoreConfig, "EncoderBackpressure", 0, "What to do when the encoder can't keep up (0: Drop frames and repeat the previous one, 1: Wait for the encoder, 2: Spill frames to a temporary file)");
+#endif
     ConfigSetDefaultString(g_CoreConfig, "SaveStatePath", "", "Path to directory where emulator save states (snapshots) are saved. If this is blank, the default value of ${UserDataPath}/save will be used");
     ConfigSetDefaultString(g_CoreConfig, "SaveSRAMPath", "", "Path to directory where SRAM/EEPROM data (in-game saves) are stored. If this is blank, the default value of ${UserDataPath}/save will be used");
     ConfigSetDefaultString(g_CoreConfig, "SharedDataPath", "", "Path to a directory to search when looking for shared data files");
@@ -686,6 +706,30 @@ void main_state_save(int format, const char *filename)
         savestates_set_job(savestates_job_save, (savestates_type)format, filename);
 }
 
+void main_state_rewind(int frames)
+{
+    if (netplay_is_init())
+        return;
+
+    rewind_request(frames);
+}
+
+void main_state_load_mem(int slot)
+{
+    if (netplay_is_init())
+        return;
+
+    savestates_set_mem_job(savestates_job_load, slot);
+}
+
+void main_state_save_mem(int slot)
+{
+    if (netplay_is_init())
+        return;
+
+    savestates_set_mem_job(savestates_job_save, slot);
+}
+
 m64p_error main_core_state_query(m64p_core_param param, int *rval)
 {
     switch (param)
@@ -958,13 +1002,14 @@ void new_frame(void)
     if (g_FrameCallback != NULL)
         (*g_FrameCallback)(l_CurrentFrame);
     
-    #ifdef ENC_SUPPORT
-    // encoder_push_video();
-    #endif
-    
     /* advance the current frame */
     l_CurrentFrame++;
 
+    ScreenshotReportCaptured();
+
+    if (l_ScreenshotInterval > 0 && l_CurrentFrame % l_ScreenshotInterval == 0 && l_TakeScreenshot == 0)
+        main_take_next_screenshot();
+
     if (l_FrameAdvance) {
         g_rom_pause = 1;
         l_FrameAdvance = 0;
@@ -972,6 +1017,16 @@ void new_frame(void)
     }
 }
 
+/* frames replayed on the way to a movie seek target run unthrottled and are not drawn */
+int main_is_replaying(void)
+{
+#ifdef VCR_SUPPORT
+    return greenzone_is_replaying();
+#else
+    return 0;
+#endif
+}
+
 static void apply_speed_limiter(void)
 {
     static unsigned long totalVIs = 0;
@@ -1024,7 +1079,7 @@ static void apply_speed_limiter(void)
         totalVIs += (unsigned long)(minSleepNeeded/AdjustedLimit);
     }
 
-    if(l_MainSpeedLimit && sleepTime > 0 && sleepTime < maxSleepNeeded*SpeedFactorMultiple)
+    if(l_MainSpeedLimit && !main_is_replaying() && sleepTime > 0 && sleepTime < maxSleepNeeded*SpeedFactorMultiple)
     {
         while(sleepTime >= 0) {
             SDL_Delay((unsigned int) sleepTime);
@@ -1058,13 +1113,23 @@ static void gs_apply_cheats(struct cheat_ctx* ctx)
     }
 }
 
+static int main_is_seeking(void)
+{
+#ifdef VCR_SUPPORT
+    return greenzone_is_seeking();
+#else
+    return 0;
+#endif
+}
+
 static void pause_loop(void)
 {
-    if(g_rom_pause)
+    /* a movie seek runs to its target frame even while paused */
+    if(g_rom_pause && !main_is_seeking())
     {
         osd_render();  // draw Paused message in case gfx.updateScreen didn't do it
         VidExt_GL_SwapBuffers();
-        while(g_rom_pause)
+        while(g_rom_pause && !main_is_seeking())
         {
             SDL_Delay(10);
             main_check_inputs();
@@ -1082,11 +1147,21 @@ void new_vi(void)
 
     gs_apply_cheats(&g_cheat_ctx);
 
+#ifdef ENC_SUPPORT
+    encoder_push_video();
+#endif
+
     apply_speed_limiter();
     main_check_inputs();
 
+#ifdef VCR_SUPPORT
+    greenzone_new_vi();
+#endif
+
     pause_loop();
 
+    rewind_new_vi();
+
     netplay_check_sync(&g_dev.r4300.cp0);
 }
 
@@ -1600,6 +1675,7 @@ m64p_error main_run(void)
     uint32_t disable_extra_mem;
     int32_t si_dma_duration;
     int32_t no_compiled_jump;
+    int32_t tier_threshold;
     int32_t randomize_interrupt;
     struct file_storage eep;
     struct file_storage fla;
@@ -1640,7 +1716,22 @@ m64p_error main_run(void)
     /* set some other core parameters based on the config file values */
     savestates_set_autoinc_slot(ConfigGetParamBool(g_CoreConfig, "AutoStateSlotIncrement"));
     savestates_select_slot(ConfigGetParamInt(g_CoreConfig, "CurrentStateSlot"));
+    savestates_set_compression(ConfigGetParamInt(g_CoreConfig, "SaveStateCompression"));
+    savestates_set_prefetch(ConfigGetParamBool(g_CoreConfig, "SaveStatePrefetch"));
+#ifdef VCR_SUPPORT
+    VCR_SetCompactStates(ConfigGetParamBool(g_CoreConfig, "SaveStateMovieDelta"));
+#endif
+    rewind_init(ConfigGetParamInt(g_CoreConfig, "RewindInterval"),
+                !netplay_is_init() ? ConfigGetParamInt(g_CoreConfig, "RewindBufferSize") : 0);
+#ifdef VCR_SUPPORT
+    greenzone_init(ConfigGetParamInt(g_CoreConfig, "GreenzoneInterval"),
+                   ConfigGetParamInt(g_CoreConfig, "GreenzoneBufferSize"));
+#endif
+    l_ScreenshotInterval = ConfigGetParamInt(g_CoreConfig, "ScreenshotInterval");
     no_compiled_jump = ConfigGetParamBool(g_CoreConfig, "NoCompiledJump");
+    tier_threshold = ConfigGetParamInt(g_CoreConfig, "DynarecTierThreshold");
+    if (tier_threshold < 0)
+        tier_threshold = 0;
     //We disable any randomness for netplay
     randomize_interrupt = !netplay_is_init() ? ConfigGetParamBool(g_CoreConfig, "RandomizeInterrupt") : 0;
     count_per_op = ConfigGetParamInt(g_CoreConfig, "CountPerOp");
@@ -1916,6 +2007,7 @@ m64p_error main_run(void)
                 count_per_op,
                 count_per_op_denom_pot,
                 no_compiled_jump,
+                tier_threshold,
                 randomize_interrupt,
                 g_start_address,
                 &g_dev.ai, &g_iaudio_out_backend_plugin_compat, ((float)ROM_SETTINGS.aidmamodifier / 100.0),
@@ -1989,6 +2081,14 @@ m64p_error main_run(void)
     run_device(&g_dev);
 
     /* now begin to shut down */
+    rewind_deinit();
+#ifdef VCR_SUPPORT
+    greenzone_deinit();
+#endif
+    savestates_set_prefetch(0);
+    ScreenshotRomClosed();
+    frame_pool_release();
+
 #ifdef WITH_LIRC
     lircStop();
 #endif // WITH_LIRC
@@ -61,6 +61,7 @@ const char* get_savestatefilename(void);
 
 void new_frame(void);
 void new_vi(void);
+int main_is_replaying(void);
 
 void main_switch_next_pak(int control_id);
 void main_switch_plugin_pak(int control_id);
@@ -85,6 +86,9 @@ void main_state_set_slot(int slot);
 void main_state_inc_slot(void);
 void main_state_load(const char *filename);
 void main_state_save(int format, const char *filename);
+void main_state_rewind(int frames);
+void main_state_load_mem(int slot);
+void main_state_save_mem(int slot);
 
 m64p_error main_core_state_query(m64p_core_param param, int *rval);
 m64p_error main_core_state_set(m64p_core_param param, int val);
@@ -0,0 +1,234 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - rewind.c                                                *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Rewind keeps the latest snapshot of the emulator state in full, and a
+ * history of backward deltas: each delta turns a snapshot into the one taken
+ * 'interval' VIs before it (see state_delta.c). Most of RDRAM does not change
+ * between two nearby snapshots, so deltas are usually a tiny fraction of the 16MB state.
+ * The oldest deltas are dropped when the memory budget is exceeded. */
+
+#include "rewind.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "api/callbacks.h"
+#include "api/m64p_types.h"
+#include "main/list.h"
+#include "main/main.h"
+#include "main/savestates.h"
+#include "main/state_delta.h"
+#include "osd/osd.h"
+
+struct rewind_delta {
+    struct list_head list;
+    size_t state_size;  /* size of the snapshot this delta restores */
+    size_t length;      /* length of data in 32-bit words */
+    uint32_t data[];
+};
+
+static rewind_job l_job = rewind_job_nothing;
+static unsigned int l_frames = 0;
+
+static unsigned int l_interval = 1;
+static unsigned int l_vi_count = 0;
+
+static size_t l_budget = 0;
+static size_t l_used = 0;
+static LIST_HEAD(l_deltas);
+
+/* latest snapshot and scratch buffer for the next one */
+static char *l_state = NULL;
+static size_t l_state_size = 0;
+static size_t l_state_capacity = 0;
+static char *l_capture = NULL;
+static size_t l_capture_capacity = 0;
+
+static void rewind_free_delta(struct rewind_delta *delta)
+{
+    list_del(&delta->list);
+    l_used -= sizeof(*delta) + delta->length * sizeof(uint32_t);
+    free(delta);
+}
+
+static void rewind_clear(void)
+{
+    while (!list_empty(&l_deltas))
+        rewind_free_delta(list_first_entry(&l_deltas, struct rewind_delta, list));
+
+    free(l_state);
+    free(l_capture);
+    l_state = l_capture = NULL;
+    l_state_size = l_state_capacity = l_capture_capacity = 0;
+    l_vi_count = 0;
+}
+
+void rewind_init(unsigned int interval, unsigned int buffer_size_mb)
+{
+    rewind_clear();
+
+    l_job = rewind_job_nothing;
+    l_interval = (interval > 0) ? interval : 1;
+    rewind_set_buffer_size(buffer_size_mb);
+}
+
+void rewind_deinit(void)
+{
+    l_job = rewind_job_nothing;
+    l_budget = 0;
+    rewind_clear();
+}
+
+void rewind_set_buffer_size(unsigned int buffer_size_mb)
+{
+    /* history is trimmed (or released) by the emulation thread on the next VI */
+    l_budget = (size_t)buffer_size_mb * 1024 * 1024;
+}
+
+void rewind_request(unsigned int frames)
+{
+    if (l_budget == 0)
+        return;
+
+    l_frames = frames;
+    l_job = rewind_job_restore;
+}
+
+void rewind_new_vi(void)
+{
+    if (l_budget == 0)
+    {
+        if (l_state != NULL)
+            rewind_clear();
+        return;
+    }
+
+    if (++l_vi_count >= l_interval && l_job == rewind_job_nothing)
+        l_job = rewind_job_capture;
+}
+
+rewind_job rewind_get_job(void)
+{
+    return l_job;
+}
+
+int rewind_capture(void)
+{
+    size_t size, capacity, words, length;
+    struct rewind_delta *delta;
+    char *swap;
+
+    l_job = rewind_job_nothing;
+    l_vi_count = 0;
+
+    size = savestates_save_to_buffer(&l_capture, &l_capture_capacity);
+    if (size == 0)
+        return 0;
+
+    if (l_state != NULL)
+    {
+        words = state_delta_words(size, l_state_size);
+        if (!state_delta_pad(&l_capture, &l_capture_capacity, size, words) ||
+            !state_delta_pad(&l_state, &l_state_capacity, l_state_size, words))
+        {
+            DebugMessage(M64MSG_WARNING, "Insufficient memory for rewind snapshot.");
+            return 0;
+        }
+
+        length = state_delta_encode(NULL, (const uint32_t *)l_state, (const uint32_t *)l_capture, words);
+        delta = malloc(sizeof(*delta) + length * sizeof(uint32_t));
+        if (delta == NULL)
+        {
+            /* the history can't be chained to the new snapshot anymore */
+            DebugMessage(M64MSG_WARNING, "Insufficient memory for rewind history, clearing it.");
+            while (!list_empty(&l_deltas))
+                rewind_free_delta(list_first_entry(&l_deltas, struct rewind_delta, list));
+        }
+        else
+        {
+            state_delta_encode(delta->data, (const uint32_t *)l_state, (const uint32_t *)l_capture, words);
+            delta->state_size = l_state_size;
+            delta->length = length;
+            list_add_tail(&delta->list, &l_deltas);
+            l_used += sizeof(*delta) + length * sizeof(uint32_t);
+        }
+
+        /* drop the oldest history to stay within budget */
+        while (l_used > l_budget && !list_empty(&l_deltas))
+            rewind_free_delta(list_first_entry(&l_deltas, struct rewind_delta, list));
+    }
+
+    /* the new snapshot becomes the latest one, the old buffer is reused for the next capture */
+    swap = l_state;
+    l_state = l_capture;
+    l_capture = swap;
+    capacity = l_state_capacity;
+    l_state_capacity = l_capture_capacity;
+    l_capture_capacity = capacity;
+    l_state_size = size;
+
+    return 1;
+}
+
+int rewind_restore(void)
+{
+    unsigned int steps = 0;
+    unsigned int rewound;
+
+    l_job = rewind_job_nothing;
+
+    if (l_state == NULL)
+    {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "No rewind history available");
+        return 0;
+    }
+
+    /* the latest snapshot is l_vi_count VIs old, each delta goes l_interval VIs further back */
+    if (l_frames > l_vi_count)
+        steps = (l_frames - l_vi_count + l_interval - 1) / l_interval;
+
+    rewound = l_vi_count;
+    while (steps-- > 0 && !list_empty(&l_deltas))
+    {
+        struct rewind_delta *delta = list_entry(l_deltas.prev, struct rewind_delta, list);
+        size_t words = state_delta_words(l_state_size, delta->state_size);
+
+        if (!state_delta_pad(&l_state, &l_state_capacity, l_state_size, words))
+        {
+            DebugMessage(M64MSG_WARNING, "Insufficient memory to rewind.");
+            break;
+        }
+
+        state_delta_apply((uint32_t *)l_state, delta->data, delta->length);
+        l_state_size = delta->state_size;
+        rewind_free_delta(delta);
+        rewound += l_interval;
+    }
+
+    if (!savestates_load_from_buffer(l_state, l_state_size))
+        return 0;
+
+    l_vi_count = 0;
+    DebugMessage(M64MSG_VERBOSE, "Rewound %u frames", rewound);
+    return 1;
+}
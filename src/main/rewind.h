@@ -0,0 +1,45 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - rewind.h                                                *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __REWIND_H__
+#define __REWIND_H__
+
+typedef enum _rewind_job
+{
+    rewind_job_nothing,
+    rewind_job_capture,
+    rewind_job_restore
+} rewind_job;
+
+void rewind_init(unsigned int interval, unsigned int buffer_size_mb);
+void rewind_deinit(void);
+
+void rewind_set_buffer_size(unsigned int buffer_size_mb);
+void rewind_request(unsigned int frames);
+
+/* called on every VI, schedules a capture every 'interval' VIs */
+void rewind_new_vi(void);
+
+rewind_job rewind_get_job(void);
+int rewind_capture(void);
+int rewind_restore(void);
+
+#endif /* __REWIND_H__ */
@@ -80,13 +80,101 @@ static int autoinc_save_slot = 0;
 
 static SDL_mutex *savestates_lock;
 
+/* Saves are written in the order they were requested, loads wait for all pending saves. */
+static SDL_cond *savestates_saved;
+static unsigned int save_ticket_next = 0;
+static unsigned int save_ticket_done = 0;
+
+static int compression = SAVESTATES_COMPRESSION_PARALLEL;
+
 struct savestate_work {
     char *filepath;
     char *data;
     size_t size;
+    int slot;
+    unsigned int ticket;
+    int compression;
+    struct work_struct work;
+};
+
+/* With SAVESTATES_COMPRESSION_PARALLEL, the state is split in chunks compressed
+ * as independent gzip members by the workqueue threads. Concatenated members
+ * still make a valid gzip file. */
+enum { SAVESTATE_CHUNK_SIZE = 0x100000 };
+
+struct savestate_chunks {
+    const char *data;
+    size_t size;
+    unsigned int count;
+    unsigned int next;
+    unsigned int done;
+    unsigned int refs;
+    int failed;
+    unsigned char **out;
+    size_t *out_size;
+    SDL_mutex *lock;
+    SDL_cond *finished;
+};
+
+struct savestate_chunks_work {
+    struct savestate_chunks *chunks;
+    struct work_struct work;
+};
+
+/* Savestate kept in memory, the buffer is reused across saves. */
+struct savestate_mem_slot {
+    char *data;
+    size_t size;
+    size_t capacity;
+};
+
+static struct savestate_mem_slot mem_slots[SAVESTATES_MEM_SLOTS_COUNT];
+static unsigned int mem_slot = 0;
+
+/* Inflated state file of a slot, kept so that slot loads don't have to read
+ * and inflate the file on the emulation thread. Entries are filled on the
+ * workqueue for the selected slot and its neighbours, and are only used
+ * while the file on disk is unchanged. Protected by savestates_lock. */
+enum { SAVESTATES_PREFETCH_NEIGHBOURS = 1 };
+
+struct savestate_prefetch {
+    char *filepath;
+    char *data;
+    size_t size;
+    size_t file_size;
+    int64_t mtime;
+    unsigned int generation;
+};
+
+struct savestate_prefetch_work {
+    unsigned int slot;
+    unsigned int generation;
+    char *filepath;
     struct work_struct work;
 };
 
+static int prefetch_enabled = 0;
+static struct savestate_prefetch prefetch_slots[10];
+
+static void savestates_prefetch(void);
+
+/* Returns the malloc'd full path of the Mupen64Plus savestate of slot s. */
+static char *savestates_generate_slot_path(unsigned int s)
+{
+    char *filepath;
+    size_t size = 0;
+
+    /* check if old file path exists, if it does then use that */
+    filepath = formatstr("%s%s.st%d", get_savestatepath(), ROM_SETTINGS.goodname, s);
+    if (get_file_size(filepath, &size) != file_ok || size == 0)
+    {
+        /* else use new path */
+        filepath = formatstr("%s%s.st%d", get_savestatepath(), get_savestatefilename(), s);
+    }
+
+    return filepath;
+}
+
 /* Returns the malloc'd full path of the currently selected savestate. */
 static char *savestates_generate_path(savestates_type type)
 {
@@ -97,18 +185,11 @@ static char *savestates_generate_path(savestates_type type)
     else /* Use the selected savestate slot */
     {
         char *filepath;
-        size_t size = 0;
 
         switch (type)
         {
             case savestates_type_m64p:
-                /* check if old file path exists, if it does then use that */
-                filepath = formatstr("%s%s.st%d", get_savestatepath(), ROM_SETTINGS.goodname, slot);
-                if (get_file_size(filepath, &size) != file_ok || size == 0)
-                {
-                    /* else use new path */
-                    filepath = formatstr("%s%s.st%d", get_savestatepath(), get_savestatefilename(), slot);
-                }
+                filepath = savestates_generate_slot_path(slot);
                 break;
             case savestates_type_pj64_zip:
                 filepath = formatstr("%s%s.pj%d.zip", get_savestatepath(), ROM_PARAMS.headername, slot);
@@ -132,6 +213,7 @@ void savestates_select_slot(unsigned int s)
     slot = s;
     ConfigSetParameter(g_CoreConfig, "CurrentStateSlot", M64TYPE_INT, &s);
     StateChanged(M64CORE_SAVESTATE_SLOT, slot);
+    savestates_prefetch();
 
     main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Selected state slot: %d", slot);
 }
@@ -148,12 +230,24 @@ void savestates_set_autoinc_slot(int b)
     autoinc_save_slot = b;
 }
 
+void savestates_set_compression(int c)
+{
+    if (c < SAVESTATES_COMPRESSION_NONE || c > SAVESTATES_COMPRESSION_PARALLEL)
+    {
+        DebugMessage(M64MSG_WARNING, "Invalid savestate compression %d, using parallel deflate.", c);
+        c = SAVESTATES_COMPRESSION_PARALLEL;
+    }
+
+    compression = c;
+}
+
 void savestates_inc_slot(void)
 {
     if(++slot>9)
         slot = 0;
     ConfigSetParameter(g_CoreConfig, "CurrentStateSlot", M64TYPE_INT, &slot);
     StateChanged(M64CORE_SAVESTATE_SLOT, slot);
+    savestates_prefetch();
 }
 
 savestates_job savestates_get_job(void)
@@ -175,6 +269,15 @@ void savestates_set_job(savestates_job j, savestates_type t, const char *fn)
         fname = strdup(fn);
 }
 
+void savestates_set_mem_job(savestates_job j, unsigned int s)
+{
+    if (s >= SAVESTATES_MEM_SLOTS_COUNT)
+        return;
+
+    savestates_set_job(j, savestates_type_m64p_mem, NULL);
+    mem_slot = s;
+}
+
 static void savestates_clear_job(void)
 {
     savestates_set_job(savestates_job_nothing, savestates_type_unknown, NULL);
@@ -206,182 +309,68 @@ static int readQueue(gzFile f, char queue[1024])
     return 0;
 }
 
-static int savestates_load_m64p(struct device* dev, char *filepath)
-{
-    unsigned char header[44];
-    gzFile f;
-    unsigned int version;
-    int i;
-    uint32_t FCR31;
-
-    size_t savestateSize;
-    unsigned char *savestateData, *curr;
-    char queue[1024];
-    unsigned char using_tlb_data[4];
-    unsigned char data_0001_0200[4096]; // 4k for extra state from v1.2
-
-    uint32_t* cp0_regs = r4300_cp0_regs(&dev->r4300.cp0);
-
-    SDL_LockMutex(savestates_lock);
-
-    f = osal_gzopen(filepath, "rb");
-    if(f==NULL)
-    {
-        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not open state file: %s", filepath);
-        SDL_UnlockMutex(savestates_lock);
-        VCR_STOP
-        return 0;
-    }
-
-    /* Read and check Mupen64Plus magic number. */
-    if (gzread(f, header, 44) != 44)
-    {
-        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not read header from state file %s", filepath);
-        gzclose(f);
-        SDL_UnlockMutex(savestates_lock);
-        VCR_STOP
-        return 0;
-    }
-    curr = header;
-
-    if(strncmp((char *)curr, savestate_magic, 8)!=0)
-    {
-        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State file: %s is not a valid Mupen64plus savestate.", filepath);
-        gzclose(f);
-        SDL_UnlockMutex(savestates_lock);
-        VCR_STOP
-        return 0;
-    }
-    curr += 8;
+/* The body of a Mupen64Plus savestate is made of the registers, RDRAM,
+ * SP and PIF memories, the TLB lookup tables and the r4300 state.
+ * RDRAM and the TLB lookup tables make up almost all of it, they can be
+ * read directly in place (dram/tlb_lut are NULL then). */
+enum {
+    SAVESTATE_M64P_REGS_SIZE = 400,
+    SAVESTATE_M64P_MEM_SIZE = SP_MEM_SIZE + PIF_RAM_SIZE + 24,
+    SAVESTATE_M64P_TLB_LUT_SIZE = 2 * 0x100000 * sizeof(uint32_t),
+    SAVESTATE_M64P_CPU_SIZE = 2348,
+    SAVESTATE_M64P_BODY_SIZE = 16788244
+};
 
-    version = *curr++;
-    version = (version << 8) | *curr++;
-    version = (version << 8) | *curr++;
-    version = (version << 8) | *curr++;
-    if((version >> 16) != (savestate_latest_version >> 16))
-    {
-        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State version (%08x) isn't compatible. Please update Mupen64Plus.", version);
-        gzclose(f);
-        SDL_UnlockMutex(savestates_lock);
-        VCR_STOP
-        return 0;
-    }
+struct savestate_m64p_body {
+    unsigned char regs[SAVESTATE_M64P_REGS_SIZE];
+    uint32_t *dram;
+    unsigned char mem[SAVESTATE_M64P_MEM_SIZE];
+    uint32_t *tlb_lut;
+    unsigned char cpu[SAVESTATE_M64P_CPU_SIZE];
+};
 
-    if(memcmp((char *)curr, ROM_SETTINGS.MD5, 32))
-    {
-        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State ROM MD5 does not match current ROM.");
-        gzclose(f);
-        SDL_UnlockMutex(savestates_lock);
-        VCR_STOP
-        return 0;
-    }
-    curr += 32;
+#ifdef VCR_SUPPORT
+/* Hands the movie data stored at the end of a savestate over to the VCR.
+ * Returns 0 if the state must not be loaded. */
+static int savestates_load_vcr_data(uint32_t isFromMovie, uint32_t* vcrbuf, uint32_t inputBufSize)
+{
+    int err;
 
-    /* Read the rest of the savestate */
-    savestateSize = 16788244;
-    savestateData = curr = (unsigned char *)malloc(savestateSize);
-    if (savestateData == NULL)
+    //movie is active but .st does not have any vcr data
+    if (VCR_IsPlaying() && !isFromMovie)
     {
-        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Insufficient memory to load state.");
-        gzclose(f);
-        SDL_UnlockMutex(savestates_lock);
-        VCR_STOP
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Can't load a non-movie state while a movie is active.");
         return 0;
     }
-    if (version == 0x00010000) /* original savestate version */
-    {
-        if (gzread(f, savestateData, savestateSize) != (int)savestateSize ||
-            !readQueue(f,queue))
-        {
-            main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not read Mupen64Plus savestate 1.0 data from %s", filepath);
-            free(savestateData);
-            gzclose(f);
-            SDL_UnlockMutex(savestates_lock);
-            VCR_STOP //.st converter spits out 1.0.0, but mupen will save them as newest
-            return 0;
-        }
-    }
-    else if (version == 0x00010100) // saves entire eventqueue plus 4-byte using_tlb flags
-    {
-        if (gzread(f, savestateData, savestateSize) != (int)savestateSize ||
-            gzread(f, queue, sizeof(queue)) != sizeof(queue) ||
-            gzread(f, using_tlb_data, sizeof(using_tlb_data)) != sizeof(using_tlb_data))
-        {
-            main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not read Mupen64Plus savestate 1.1 data from %s", filepath);
-            free(savestateData);
-            gzclose(f);
-            SDL_UnlockMutex(savestates_lock);
-            return 0;
-        }
-    }
-    else // version >= 0x00010200  saves entire eventqueue, 4-byte using_tlb flags and extra state
+    //movie active and is from movie
+    else if (VCR_IsPlaying() && isFromMovie)
     {
-        if (gzread(f, savestateData, savestateSize) != (int)savestateSize ||
-            gzread(f, queue, sizeof(queue)) != sizeof(queue) ||
-            gzread(f, using_tlb_data, sizeof(using_tlb_data)) != sizeof(using_tlb_data) ||
-            gzread(f, data_0001_0200, sizeof(data_0001_0200)) != sizeof(data_0001_0200))
+        if (vcrbuf == NULL || !inputBufSize)
         {
-            main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not read Mupen64Plus savestate 1.2+ data from %s", filepath);
-            free(savestateData);
-            gzclose(f);
-            SDL_UnlockMutex(savestates_lock);
-            VCR_STOP
+            main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Savestate has invalid movie data.");
             return 0;
         }
-    }
-
-#ifdef VCR_SUPPORT
-    //try to read VCR data at the end, it can be absent if .st is not form movie
-    //only try 1.8.1 and 1.0.0 because if .st version gets changed by real devs we dont want to mess with that.
-    //maybe could check for x.x.1 instead where 1 means vcr support?... sketchy, might change later
-    
-    //this code is based on old mupen code
-    if (version == 0x00010000 || version == 0x00010801)
-    {
-        uint32_t isFromMovie = 0;
-        gzread(f,&isFromMovie, sizeof(isFromMovie));
-        //movie is active but .st does not have any vcr data
-        if (VCR_IsPlaying() && !isFromMovie)
+        if ((err = VCR_LoadMovieData(vcrbuf, inputBufSize)))
         {
-            main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Can't load a non-movie state while a movie is active.");
-            gzclose(f);
-            SDL_UnlockMutex(savestates_lock);
+            main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "VCR .st error: %s", VCR_LoadStateErrors[err]);
             return 0;
         }
-        //movie active and is from movie
-        //Note: it doesn't try to parse the data if movie is not active, as opposed to old mupen, this isn't needed anymore
-        else if (VCR_IsPlaying() && isFromMovie)
-        {
-            uint32_t inputBufSize = 0;
-            int res = gzread(f, &inputBufSize, sizeof(inputBufSize));
-            if (res!= sizeof(inputBufSize) || !inputBufSize) //either error happened or less bytes than enough were read
-            {
-                main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Savestate has invalid movie data.");
-                gzclose(f);
-                SDL_UnlockMutex(savestates_lock);
-                return 0;
-            }
-            uint32_t* vcrbuf = (uint32_t*)malloc(inputBufSize);
-            gzread(f, vcrbuf, inputBufSize);
-            int err;
-            if ((err = VCR_LoadMovieData(vcrbuf,inputBufSize)))
-            {
-                main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "VCR .st error: %s", VCR_LoadStateErrors[err]);
-                gzclose(f);
-                SDL_UnlockMutex(savestates_lock);
-                free(vcrbuf);
-                return 0;
-            }
-            free(vcrbuf);
-
-        }
     }
+    return 1;
+}
 #endif
-    gzclose(f);
 
-    SDL_UnlockMutex(savestates_lock);
+/* Restores the device from the body of a Mupen64Plus savestate. */
+static void savestates_load_m64p_data(struct device* dev, unsigned int version,
+                                      struct savestate_m64p_body *body, char *queue,
+                                      unsigned char *using_tlb_data, unsigned char *data_0001_0200)
+{
+    int i;
+    uint32_t FCR31;
+    unsigned char *curr = body->regs;
+
+    uint32_t* cp0_regs = r4300_cp0_regs(&dev->r4300.cp0);
 
-    // Parse savestate
     dev->rdram.regs[0][RDRAM_CONFIG_REG]       = GETDATA(curr, uint32_t);
     dev->rdram.regs[0][RDRAM_DEVICE_ID_REG]    = GETDATA(curr, uint32_t);
     dev->rdram.regs[0][RDRAM_DELAY_REG]        = GETDATA(curr, uint32_t);
@@ -496,7 +485,16 @@ static int savestates_load_m64p(struct device* dev, char *filepath)
     dev->dp.dps_regs[DPS_BUFTEST_ADDR_REG] = GETDATA(curr, uint32_t);
     dev->dp.dps_regs[DPS_BUFTEST_DATA_REG] = GETDATA(curr, uint32_t);
 
-    COPYARRAY(dev->rdram.dram, curr, uint32_t, RDRAM_MAX_SIZE/4);
+    if (body->dram != NULL)
+    {
+        curr = (unsigned char *)body->dram;
+        body->dram = GETARRAY(curr, uint32_t, RDRAM_MAX_SIZE/4);
+        invalidate_r4300_non_rdram_code(&dev->r4300);
+        invalidate_r4300_changed_code(&dev->r4300, 0, body->dram, RDRAM_MAX_SIZE);
+        memcpy(dev->rdram.dram, body->dram, RDRAM_MAX_SIZE);
+    }
+
+    curr = body->mem;
     COPYARRAY(dev->sp.mem, curr, uint32_t, SP_MEM_SIZE/4);
     COPYARRAY(dev->pif.ram, curr, uint8_t, PIF_RAM_SIZE);
 
@@ -505,9 +503,14 @@ static int savestates_load_m64p(struct device* dev, char *filepath)
     /* by default, reset flashram state here and load it later if available */
     poweron_flashram(&dev->cart.flashram);
 
-    COPYARRAY(dev->r4300.cp0.tlb.LUT_r, curr, uint32_t, 0x100000);
-    COPYARRAY(dev->r4300.cp0.tlb.LUT_w, curr, uint32_t, 0x100000);
+    if (body->tlb_lut != NULL)
+    {
+        curr = (unsigned char *)body->tlb_lut;
+        COPYARRAY(dev->r4300.cp0.tlb.LUT_r, curr, uint32_t, 0x100000);
+        COPYARRAY(dev->r4300.cp0.tlb.LUT_w, curr, uint32_t, 0x100000);
+    }
 
+    curr = body->cpu;
     *r4300_llbit(&dev->r4300) = GETDATA(curr, uint32_t);
     COPYARRAY(r4300_regs(&dev->r4300), curr, int64_t, 32);
     COPYARRAY(cp0_regs, curr, uint32_t, CP0_REGS_COUNT);
@@ -970,70 +973,657 @@ static int savestates_load_m64p(struct device* dev, char *filepath)
         dev->cart.af_rtc.now = 0;
         dev->cart.af_rtc.last_update_rtc = 0;
 
-        /* extra controllers state */
-        for(i = 0; i < GAME_CONTROLLERS_COUNT; ++i) {
-            /* skip controllers handled by the input plugin */
-            if (Controls[i].RawData)
-                continue;
+        /* extra controllers state */
+        for(i = 0; i < GAME_CONTROLLERS_COUNT; ++i) {
+            /* skip controllers handled by the input plugin */
+            if (Controls[i].RawData)
+                continue;
+
+            dev->controllers[i].flavor->reset(&dev->controllers[i]);
+
+            if (ROM_SETTINGS.rumble && (Controls[i].Type == CONT_TYPE_STANDARD)) {
+                poweron_rumblepak(&dev->rumblepaks[i]);
+            }
+            if (ROM_SETTINGS.transferpak && (Controls[i].Type == CONT_TYPE_STANDARD)) {
+                poweron_transferpak(&dev->transferpaks[i]);
+            }
+        }
+
+        /* extra pif channels state
+         * HACK: Assume PIF was in channel processing mode (and not in CIC challenge mode)
+         * Try to parse pif ram to setup pif channels
+         */
+        setup_channels_format(&dev->pif);
+
+        /* extra vi state */
+        dev->vi.count_per_scanline = (dev->vi.regs[VI_V_SYNC_REG] == 0)
+            ? 1500
+            : ((dev->vi.clock / dev->vi.expected_refresh_rate) / (dev->vi.regs[VI_V_SYNC_REG] + 1));
+
+        /* extra si state */
+        dev->si.dma_dir = SI_NO_DMA;
+
+        /* extra dp state */
+        dev->dp.do_on_unfreeze = 0;
+
+        /* extra rdram state
+         * Best effort, copy values from RDRAM module 0 except for DEVICE_ID
+         * which is set in accordance with the IPL3 procedure with 2M modules.
+         */
+        for (i = 0; i < RDRAM_MAX_MODULES_COUNT; ++i) {
+            memcpy(dev->rdram.regs[i], dev->rdram.regs[0], RDRAM_REGS_COUNT*sizeof(dev->rdram.regs[0][0]));
+            dev->rdram.regs[i][RDRAM_DEVICE_ID_REG] = ri_address_to_id_field(i * 0x200000) << 2;
+        }
+
+        /* dd state */
+        if (dev->dd.rom_size > 0 && dev->dd.idisk != NULL) {
+            poweron_dd(&dev->dd);
+        }
+    }
+
+    /* Zilmar-Spec plugin expect a call with control_id = -1 when RAM processing is done */
+    if (input.controllerCommand) {
+        input.controllerCommand(-1, NULL);
+    }
+
+    /* reset fb state */
+    poweron_fb(&dev->dp.fb);
+
+    dev->sp.rsp_task_locked = 0;
+    dev->r4300.cp0.interrupt_unsafe_state = 0;
+
+    *r4300_cp0_last_addr(&dev->r4300.cp0) = *r4300_pc(&dev->r4300);
+}
+
+/* Reads the savestate body from f. RDRAM and the TLB lookup tables are read
+ * in buffer when given, else they are inflated directly in place, in a single
+ * pass: a failure after the registers leaves the device partially loaded. */
+static int savestates_read_m64p_body(struct device* dev, gzFile f, struct savestate_m64p_body *body, uint32_t *buffer)
+{
+    uint32_t chunk[0x1000];
+    uint32_t address;
+
+    if (gzread(f, body->regs, sizeof(body->regs)) != (int)sizeof(body->regs))
+        return 0;
+
+    if (buffer != NULL)
+    {
+        body->dram = buffer;
+        if (gzread(f, body->dram, RDRAM_MAX_SIZE) != RDRAM_MAX_SIZE)
+            return 0;
+    }
+    else
+    {
+        /* code compiled from pages that change is invalidated before they are overwritten */
+        body->dram = NULL;
+        invalidate_r4300_non_rdram_code(&dev->r4300);
+        for (address = 0; address < RDRAM_MAX_SIZE; address += sizeof(chunk))
+        {
+            if (gzread(f, chunk, sizeof(chunk)) != (int)sizeof(chunk))
+                return 0;
+
+            to_little_endian_buffer(chunk, sizeof(uint32_t), sizeof(chunk) / sizeof(uint32_t));
+            invalidate_r4300_changed_code(&dev->r4300, address, chunk, sizeof(chunk));
+            memcpy((unsigned char *)dev->rdram.dram + address, chunk, sizeof(chunk));
+        }
+    }
+
+    if (gzread(f, body->mem, sizeof(body->mem)) != (int)sizeof(body->mem))
+        return 0;
+
+    if (buffer != NULL)
+    {
+        body->tlb_lut = buffer + RDRAM_MAX_SIZE / sizeof(uint32_t);
+        if (gzread(f, body->tlb_lut, SAVESTATE_M64P_TLB_LUT_SIZE) != SAVESTATE_M64P_TLB_LUT_SIZE)
+            return 0;
+    }
+    else
+    {
+        body->tlb_lut = NULL;
+        if (gzread(f, dev->r4300.cp0.tlb.LUT_r, sizeof(dev->r4300.cp0.tlb.LUT_r)) != (int)sizeof(dev->r4300.cp0.tlb.LUT_r)
+         || gzread(f, dev->r4300.cp0.tlb.LUT_w, sizeof(dev->r4300.cp0.tlb.LUT_w)) != (int)sizeof(dev->r4300.cp0.tlb.LUT_w))
+            return 0;
+
+        to_little_endian_buffer(dev->r4300.cp0.tlb.LUT_r, sizeof(uint32_t), 0x100000);
+        to_little_endian_buffer(dev->r4300.cp0.tlb.LUT_w, sizeof(uint32_t), 0x100000);
+    }
+
+    return gzread(f, body->cpu, sizeof(body->cpu)) == (int)sizeof(body->cpu);
+}
+
+/* A state file read in place turned out to be truncated or corrupt past its
+ * header. The device memories are partially overwritten by now, there is no
+ * going back to the previous state. */
+static void savestates_reset_after_failed_load(const char *filepath)
+{
+    main_message(M64MSG_ERROR, OSD_BOTTOM_LEFT, "State file %s is truncated or corrupt, resetting.", filepath);
+    main_reset(1);
+}
+
+static int savestates_load_m64p(struct device* dev, char *filepath)
+{
+    unsigned char header[44];
+    gzFile f;
+    unsigned int version;
+
+    unsigned char *curr;
+    uint32_t *buffer = NULL;
+    struct savestate_m64p_body body;
+    char queue[1024];
+    unsigned char using_tlb_data[4];
+    unsigned char data_0001_0200[4096]; // 4k for extra state from v1.2
+
+    SDL_LockMutex(savestates_lock);
+    while (save_ticket_done != save_ticket_next)
+        SDL_CondWait(savestates_saved, savestates_lock);
+
+    f = osal_gzopen(filepath, "rb");
+    if(f==NULL)
+    {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not open state file: %s", filepath);
+        SDL_UnlockMutex(savestates_lock);
+        VCR_STOP
+        return 0;
+    }
+
+    /* Read and check Mupen64Plus magic number. */
+    if (gzread(f, header, 44) != 44)
+    {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not read header from state file %s", filepath);
+        gzclose(f);
+        SDL_UnlockMutex(savestates_lock);
+        VCR_STOP
+        return 0;
+    }
+    curr = header;
+
+    if(strncmp((char *)curr, savestate_magic, 8)!=0)
+    {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State file: %s is not a valid Mupen64plus savestate.", filepath);
+        gzclose(f);
+        SDL_UnlockMutex(savestates_lock);
+        VCR_STOP
+        return 0;
+    }
+    curr += 8;
+
+    version = *curr++;
+    version = (version << 8) | *curr++;
+    version = (version << 8) | *curr++;
+    version = (version << 8) | *curr++;
+    if((version >> 16) != (savestate_latest_version >> 16))
+    {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State version (%08x) isn't compatible. Please update Mupen64Plus.", version);
+        gzclose(f);
+        SDL_UnlockMutex(savestates_lock);
+        VCR_STOP
+        return 0;
+    }
+
+    if(memcmp((char *)curr, ROM_SETTINGS.MD5, 32))
+    {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State ROM MD5 does not match current ROM.");
+        gzclose(f);
+        SDL_UnlockMutex(savestates_lock);
+        VCR_STOP
+        return 0;
+    }
+    curr += 32;
+
+    /* Read the rest of the savestate */
+#ifdef VCR_SUPPORT
+    /* The movie data at the end of the state can still reject it, keep the device untouched until then */
+    if (VCR_IsPlaying())
+    {
+        buffer = (uint32_t *)malloc(RDRAM_MAX_SIZE + SAVESTATE_M64P_TLB_LUT_SIZE);
+        if (buffer == NULL)
+        {
+            main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Insufficient memory to load state.");
+            gzclose(f);
+            SDL_UnlockMutex(savestates_lock);
+            VCR_STOP
+            return 0;
+        }
+    }
+#endif
+    if (version == 0x00010000) /* original savestate version */
+    {
+        if (!savestates_read_m64p_body(dev, f, &body, buffer) ||
+            !readQueue(f,queue))
+        {
+            main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not read Mupen64Plus savestate 1.0 data from %s", filepath);
+            if (buffer == NULL)
+                savestates_reset_after_failed_load(filepath);
+            free(buffer);
+            gzclose(f);
+            SDL_UnlockMutex(savestates_lock);
+            VCR_STOP //.st converter spits out 1.0.0, but mupen will save them as newest
+            return 0;
+        }
+    }
+    else if (version == 0x00010100) // saves entire eventqueue plus 4-byte using_tlb flags
+    {
+        if (!savestates_read_m64p_body(dev, f, &body, buffer) ||
+            gzread(f, queue, sizeof(queue)) != sizeof(queue) ||
+            gzread(f, using_tlb_data, sizeof(using_tlb_data)) != sizeof(using_tlb_data))
+        {
+            main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not read Mupen64Plus savestate 1.1 data from %s", filepath);
+            if (buffer == NULL)
+                savestates_reset_after_failed_load(filepath);
+            free(buffer);
+            gzclose(f);
+            SDL_UnlockMutex(savestates_lock);
+            return 0;
+        }
+    }
+    else // version >= 0x00010200  saves entire eventqueue, 4-byte using_tlb flags and extra state
+    {
+        if (!savestates_read_m64p_body(dev, f, &body, buffer) ||
+            gzread(f, queue, sizeof(queue)) != sizeof(queue) ||
+            gzread(f, using_tlb_data, sizeof(using_tlb_data)) != sizeof(using_tlb_data) ||
+            gzread(f, data_0001_0200, sizeof(data_0001_0200)) != sizeof(data_0001_0200))
+        {
+            main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not read Mupen64Plus savestate 1.2+ data from %s", filepath);
+            if (buffer == NULL)
+                savestates_reset_after_failed_load(filepath);
+            free(buffer);
+            gzclose(f);
+            SDL_UnlockMutex(savestates_lock);
+            VCR_STOP
+            return 0;
+        }
+    }
+
+#ifdef VCR_SUPPORT
+    //try to read VCR data at the end, it can be absent if .st is not form movie
+    //only try 1.9.1, 1.8.1 and 1.0.0 because if .st version gets changed by real devs we dont want to mess with that.
+    //maybe could check for x.x.1 instead where 1 means vcr support?... sketchy, might change later
+    
+    //this code is based on old mupen code
+    if (version == 0x00010000 || version == 0x00010801 || version == 0x00010901)
+    {
+        uint32_t isFromMovie = 0;
+        uint32_t inputBufSize = 0;
+        uint32_t* vcrbuf = NULL;
+        int res;
+        gzread(f,&isFromMovie, sizeof(isFromMovie));
+        //Note: it doesn't try to parse the data if movie is not active, as opposed to old mupen, this isn't needed anymore
+        if (VCR_IsPlaying() && isFromMovie)
+        {
+            res = gzread(f, &inputBufSize, sizeof(inputBufSize));
+            if (res != sizeof(inputBufSize)) //either error happened or less bytes than enough were read
+                inputBufSize = 0;
+            if (inputBufSize)
+            {
+                vcrbuf = (uint32_t*)malloc(inputBufSize);
+                if (vcrbuf == NULL)
+                {
+                    main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Insufficient memory to load state.");
+                    gzclose(f);
+                    SDL_UnlockMutex(savestates_lock);
+                    free(buffer);
+                    return 0;
+                }
+                //a short read leaves the movie data out, it is reported as invalid
+                res = gzread(f, vcrbuf, inputBufSize);
+                if (res < 0 || (uint32_t)res != inputBufSize)
+                {
+                    free(vcrbuf);
+                    vcrbuf = NULL;
+                    inputBufSize = 0;
+                }
+            }
+        }
+        res = savestates_load_vcr_data(isFromMovie, vcrbuf, inputBufSize);
+        free(vcrbuf);
+        if (!res)
+        {
+            gzclose(f);
+            SDL_UnlockMutex(savestates_lock);
+            free(buffer);
+            return 0;
+        }
+    }
+#endif
+    gzclose(f);
+
+    SDL_UnlockMutex(savestates_lock);
+
+    savestates_load_m64p_data(dev, version, &body, queue, using_tlb_data, data_0001_0200);
+
+    free(buffer);
+    main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State loaded from: %s", namefrompath(filepath));
+    return 1;
+}
+
+/* Loads an uncompressed savestate produced by savestates_serialize_m64p. */
+static int savestates_load_m64p_buffer(struct device* dev, const char *buffer, size_t size)
+{
+    unsigned char *data, *curr;
+    unsigned int version;
+    struct savestate_m64p_body body;
+
+    /* Memory states are always written by this core in the latest format,
+     * only make sure they are complete and belong to the current ROM. */
+    if (size < 44 + SAVESTATE_M64P_BODY_SIZE + 1024 + 4 + 4096)
+    {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State is truncated.");
+        return 0;
+    }
+
+    curr = (unsigned char *)buffer + 8;
+    version = *curr++;
+    version = (version << 8) | *curr++;
+    version = (version << 8) | *curr++;
+    version = (version << 8) | *curr++;
+
+    if (memcmp((char *)curr, ROM_SETTINGS.MD5, 32))
+    {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State ROM MD5 does not match current ROM.");
+        return 0;
+    }
+
+#ifdef M64P_BIG_ENDIAN
+    /* Parsing byteswaps the data in place, keep the slot intact for the next load */
+    data = (unsigned char *)malloc(size);
+    if (data == NULL)
+    {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Insufficient memory to load state.");
+        return 0;
+    }
+    memcpy(data, buffer, size);
+#else
+    data = (unsigned char *)buffer;
+#endif
+
+    /* Same layout as the uncompressed savestate file */
+    unsigned char *savestateData = data + 44;
+    char *queue = (char *)savestateData + SAVESTATE_M64P_BODY_SIZE;
+    unsigned char *using_tlb_data = (unsigned char *)queue + 1024;
+    unsigned char *data_0001_0200 = using_tlb_data + 4;
+
+#ifdef VCR_SUPPORT
+    curr = data_0001_0200 + 4096;
+    uint32_t isFromMovie = 0;
+    uint32_t inputBufSize = 0;
+    uint32_t* vcrbuf = NULL;
+    if (size >= (size_t)(curr - data) + 4)
+        isFromMovie = GETDATA(curr, uint32_t);
+    if (isFromMovie && size >= (size_t)(curr - data) + 4)
+    {
+        inputBufSize = GETDATA(curr, uint32_t);
+        /* an input buffer running past the end of the state is left out, it is reported as invalid */
+        if (inputBufSize <= size - (size_t)(curr - data))
+            vcrbuf = (uint32_t *)curr;
+        else
+            inputBufSize = 0;
+    }
+    if (!savestates_load_vcr_data(isFromMovie, vcrbuf, inputBufSize))
+    {
+#ifdef M64P_BIG_ENDIAN
+        free(data);
+#endif
+        return 0;
+    }
+#endif
+
+    curr = savestateData;
+    memcpy(body.regs, curr, sizeof(body.regs));
+    curr += sizeof(body.regs);
+    body.dram = (uint32_t *)curr;
+    curr += RDRAM_MAX_SIZE;
+    memcpy(body.mem, curr, sizeof(body.mem));
+    curr += sizeof(body.mem);
+    body.tlb_lut = (uint32_t *)curr;
+    curr += SAVESTATE_M64P_TLB_LUT_SIZE;
+    memcpy(body.cpu, curr, sizeof(body.cpu));
+
+    savestates_load_m64p_data(dev, version, &body, queue, using_tlb_data, data_0001_0200);
+
+#ifdef M64P_BIG_ENDIAN
+    free(data);
+#endif
+    return 1;
+}
+
+static int savestates_load_m64p_mem(struct device* dev, unsigned int s)
+{
+    const struct savestate_mem_slot* mem = &mem_slots[s];
+
+    if (mem->size == 0)
+    {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "No in-memory state in slot %u", s);
+        return 0;
+    }
+
+    if (!savestates_load_m64p_buffer(dev, mem->data, mem->size))
+        return 0;
+
+    DebugMessage(M64MSG_VERBOSE, "State loaded from memory slot %u", s);
+    return 1;
+}
+
+/* Inflates a Mupen64Plus savestate file in the latest format into a malloc'd buffer.
+ * Returns NULL if the file can't be read or is in another format. */
+static char *savestates_inflate_m64p(const char *filepath, size_t *size)
+{
+    gzFile f;
+    char *data, *newdata;
+    size_t capacity;
+    int n;
+
+    /* header, body, event queue, using_tlb and extra state, followed by the movie data */
+    const size_t min_size = 44 + SAVESTATE_M64P_BODY_SIZE + 1024 + 4 + 4096
+#ifdef VCR_SUPPORT
+        + 4
+#endif
+        ;
+
+    f = osal_gzopen(filepath, "rb");
+    if (f == NULL)
+        return NULL;
+
+    capacity = min_size + 4;
+    data = malloc(capacity);
+    if (data == NULL)
+    {
+        gzclose(f);
+        return NULL;
+    }
+
+    *size = 0;
+    while ((n = gzread(f, data + *size, (unsigned int)(capacity - *size))) > 0)
+    {
+        *size += n;
+        if (*size < capacity)
+            continue;
+
+        newdata = realloc(data, capacity * 2);
+        if (newdata == NULL)
+        {
+            n = -1;
+            break;
+        }
+        data = newdata;
+        capacity *= 2;
+    }
+    gzclose(f);
+
+    if (n < 0 || *size < min_size
+     || strncmp(data, savestate_magic, 8) != 0
+     || (uint32_t)(((unsigned char)data[8] << 24) | ((unsigned char)data[9] << 16)
+                 | ((unsigned char)data[10] << 8) | (unsigned char)data[11]) != (uint32_t)savestate_latest_version)
+    {
+        free(data);
+        return NULL;
+    }
+
+    return data;
+}
+
+static void savestates_prefetch_free(struct savestate_prefetch *entry)
+{
+    free(entry->filepath);
+    free(entry->data);
+    entry->filepath = NULL;
+    entry->data = NULL;
+    entry->size = 0;
+    ++entry->generation;
+}
+
+static void savestates_prefetch_work(struct work_struct *work)
+{
+    struct savestate_prefetch_work *prefetch = container_of(work, struct savestate_prefetch_work, work);
+    struct savestate_prefetch *entry = &prefetch_slots[prefetch->slot];
+    int64_t mtime = 0;
+    size_t file_size = 0;
+    char *data = NULL;
+    size_t size = 0;
+    int skip;
+
+    if (osal_file_mtime(prefetch->filepath, &mtime) == 0
+     && get_file_size(prefetch->filepath, &file_size) == file_ok)
+    {
+        SDL_LockMutex(savestates_lock);
+        skip = (prefetch->generation != entry->generation)
+            || (entry->data != NULL
+             && strcmp(entry->filepath, prefetch->filepath) == 0
+             && entry->mtime == mtime && entry->file_size == file_size);
+        SDL_UnlockMutex(savestates_lock);
+
+        if (skip)
+            goto done;
+
+        data = savestates_inflate_m64p(prefetch->filepath, &size);
+    }
+
+    SDL_LockMutex(savestates_lock);
+    /* a newer request or a save to this file supersedes this one */
+    if (prefetch->generation == entry->generation)
+    {
+        savestates_prefetch_free(entry);
+        if (data != NULL)
+        {
+            entry->filepath = prefetch->filepath;
+            entry->data = data;
+            entry->size = size;
+            entry->file_size = file_size;
+            entry->mtime = mtime;
+            prefetch->filepath = NULL;
+            data = NULL;
+        }
+    }
+    SDL_UnlockMutex(savestates_lock);
+
+done:
+    free(data);
+    free(prefetch->filepath);
+    free(prefetch);
+}
 
-            dev->controllers[i].flavor->reset(&dev->controllers[i]);
+static int savestates_prefetch_wanted(unsigned int s)
+{
+    unsigned int distance = (s + 10 - slot) % 10;
 
-            if (ROM_SETTINGS.rumble && (Controls[i].Type == CONT_TYPE_STANDARD)) {
-                poweron_rumblepak(&dev->rumblepaks[i]);
-            }
-            if (ROM_SETTINGS.transferpak && (Controls[i].Type == CONT_TYPE_STANDARD)) {
-                poweron_transferpak(&dev->transferpaks[i]);
-            }
-        }
+    return prefetch_enabled
+        && (distance <= SAVESTATES_PREFETCH_NEIGHBOURS || distance >= 10 - SAVESTATES_PREFETCH_NEIGHBOURS);
+}
 
-        /* extra pif channels state
-         * HACK: Assume PIF was in channel processing mode (and not in CIC challenge mode)
-         * Try to parse pif ram to setup pif channels
-         */
-        setup_channels_format(&dev->pif);
+/* Prepares the inflation of filepath for slot s, superseding pending ones.
+ * Must be called with savestates_lock held, the work is queued by the caller. */
+static struct savestate_prefetch_work *savestates_prefetch_request(unsigned int s, char *filepath)
+{
+    struct savestate_prefetch_work *prefetch;
 
-        /* extra vi state */
-        dev->vi.count_per_scanline = (dev->vi.regs[VI_V_SYNC_REG] == 0)
-            ? 1500
-            : ((dev->vi.clock / dev->vi.expected_refresh_rate) / (dev->vi.regs[VI_V_SYNC_REG] + 1));
+    prefetch = malloc(sizeof(*prefetch));
+    if (prefetch == NULL || filepath == NULL)
+    {
+        free(prefetch);
+        free(filepath);
+        return NULL;
+    }
 
-        /* extra si state */
-        dev->si.dma_dir = SI_NO_DMA;
+    prefetch->slot = s;
+    prefetch->generation = ++prefetch_slots[s].generation;
+    prefetch->filepath = filepath;
+    init_work(&prefetch->work, savestates_prefetch_work);
+    return prefetch;
+}
 
-        /* extra dp state */
-        dev->dp.do_on_unfreeze = 0;
+/* Queues the inflation of the selected slot and its neighbours, and drops the other slots. */
+static void savestates_prefetch(void)
+{
+    struct savestate_prefetch_work *works[10];
+    size_t count = 0, i;
+    unsigned int s;
 
-        /* extra rdram state
-         * Best effort, copy values from RDRAM module 0 except for DEVICE_ID
-         * which is set in accordance with the IPL3 procedure with 2M modules.
-         */
-        for (i = 0; i < RDRAM_MAX_MODULES_COUNT; ++i) {
-            memcpy(dev->rdram.regs[i], dev->rdram.regs[0], RDRAM_REGS_COUNT*sizeof(dev->rdram.regs[0][0]));
-            dev->rdram.regs[i][RDRAM_DEVICE_ID_REG] = ri_address_to_id_field(i * 0x200000) << 2;
-        }
+    if (!prefetch_enabled)
+        return;
 
-        /* dd state */
-        if (dev->dd.rom_size > 0 && dev->dd.idisk != NULL) {
-            poweron_dd(&dev->dd);
+    SDL_LockMutex(savestates_lock);
+    for (s = 0; s < 10; ++s)
+    {
+        if (!savestates_prefetch_wanted(s))
+        {
+            if (prefetch_slots[s].filepath != NULL)
+                savestates_prefetch_free(&prefetch_slots[s]);
+        }
+        else if ((works[count] = savestates_prefetch_request(s, savestates_generate_slot_path(s))) != NULL)
+        {
+            ++count;
         }
     }
+    SDL_UnlockMutex(savestates_lock);
 
-    /* Zilmar-Spec plugin expect a call with control_id = -1 when RAM processing is done */
-    if (input.controllerCommand) {
-        input.controllerCommand(-1, NULL);
+    for (i = 0; i < count; ++i)
+        queue_work(&works[i]->work);
+}
+
+/* Restores the state of slot s from the prefetch cache if it matches filepath on disk.
+ * Returns -1 if the file has to be read instead. */
+static int savestates_load_m64p_prefetched(struct device* dev, unsigned int s, const char *filepath)
+{
+    const struct savestate_prefetch *entry = &prefetch_slots[s];
+    int64_t mtime;
+    size_t file_size;
+    int ret = -1;
+
+    if (!prefetch_enabled)
+        return -1;
+
+    SDL_LockMutex(savestates_lock);
+    while (save_ticket_done != save_ticket_next)
+        SDL_CondWait(savestates_saved, savestates_lock);
+
+    if (entry->data != NULL
+     && strcmp(entry->filepath, filepath) == 0
+     && osal_file_mtime(filepath, &mtime) == 0
+     && get_file_size(filepath, &file_size) == file_ok
+     && entry->mtime == mtime && entry->file_size == file_size)
+    {
+        ret = savestates_load_m64p_buffer(dev, entry->data, entry->size);
+        if (ret)
+            main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State loaded from: %s", namefrompath(filepath));
     }
+    SDL_UnlockMutex(savestates_lock);
 
-    /* reset fb state */
-    poweron_fb(&dev->dp.fb);
+    return ret;
+}
 
-    dev->sp.rsp_task_locked = 0;
-    dev->r4300.cp0.interrupt_unsafe_state = 0;
+void savestates_set_prefetch(int enable)
+{
+    unsigned int s;
 
-    *r4300_cp0_last_addr(&dev->r4300.cp0) = *r4300_pc(&dev->r4300);
+    SDL_LockMutex(savestates_lock);
+    prefetch_enabled = enable;
+    if (!enable)
+    {
+        for (s = 0; s < 10; ++s)
+            savestates_prefetch_free(&prefetch_slots[s]);
+    }
+    SDL_UnlockMutex(savestates_lock);
 
-    free(savestateData);
-    main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "State loaded from: %s", namefrompath(filepath));
-    return 1;
+    savestates_prefetch();
 }
 
 static int savestates_load_pj64(struct device* dev,
@@ -1044,6 +1634,8 @@ static int savestates_load_pj64(struct device* dev,
     unsigned int vi_timer, SaveRDRAMSize;
     size_t i;
     uint32_t FCR31;
+    const uint32_t* dram;
+    static const uint32_t zero_page[0x1000 / sizeof(uint32_t)];
 
     unsigned char header[8];
     unsigned char RomHeader[0x40];
@@ -1313,8 +1905,13 @@ static int savestates_load_pj64(struct device* dev,
     }
 
     // RDRAM
+    dram = GETARRAY(curr, uint32_t, SaveRDRAMSize/4);
+    invalidate_r4300_non_rdram_code(&dev->r4300);
+    invalidate_r4300_changed_code(&dev->r4300, 0, dram, SaveRDRAMSize);
+    for (i = SaveRDRAMSize; i < RDRAM_MAX_SIZE; i += sizeof(zero_page))
+        invalidate_r4300_changed_code(&dev->r4300, (uint32_t)i, zero_page, sizeof(zero_page));
     memset(dev->rdram.dram, 0, RDRAM_MAX_SIZE);
-    COPYARRAY(dev->rdram.dram, curr, uint32_t, SaveRDRAMSize/4);
+    memcpy(dev->rdram.dram, dram, SaveRDRAMSize);
 
     // DMEM + IMEM
     COPYARRAY(dev->sp.mem, curr, uint32_t, SP_MEM_SIZE/4);
@@ -1481,6 +2078,15 @@ int savestates_load(void)
     char *filepath = NULL;
     int ret = 0;
 
+    if (type == savestates_type_m64p_mem)
+    {
+        ret = savestates_load_m64p_mem(&g_dev, mem_slot);
+
+        StateChanged(M64CORE_STATE_LOADCOMPLETE, ret);
+        savestates_clear_job();
+        return ret;
+    }
+
     if (fname == NULL) // For slots, autodetect the savestate type
     {
         // try M64P type first
@@ -1538,7 +2144,11 @@ int savestates_load(void)
 
         switch (type)
         {
-            case savestates_type_m64p: ret = savestates_load_m64p(dev, filepath); break;
+            case savestates_type_m64p:
+                ret = (fname == NULL) ? savestates_load_m64p_prefetched(dev, slot, filepath) : -1;
+                if (ret < 0)
+                    ret = savestates_load_m64p(dev, filepath);
+                break;
             case savestates_type_pj64_zip: ret = savestates_load_pj64_zip(dev, filepath); break;
             case savestates_type_pj64_unc: ret = savestates_load_pj64_unc(dev, filepath); break;
             default: ret = 0; break;
@@ -1555,22 +2165,22 @@ int savestates_load(void)
     return ret;
 }
 
-static void savestates_save_m64p_work(struct work_struct *work)
+static int savestates_write_gzip(const struct savestate_work *save, int level)
 {
     gzFile f;
     int gzres;
-    struct savestate_work *save = container_of(work, struct savestate_work, work);
+    char mode[4] = "wb";
 
-    SDL_LockMutex(savestates_lock);
+    if (level >= 0 && level <= 9)
+        mode[2] = (char)('0' + level);
 
     // Write the state to a GZIP file
-    f = osal_gzopen(save->filepath, "wb");
+    f = osal_gzopen(save->filepath, mode);
 
     if (f==NULL)
     {
         main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not open state file: %s", save->filepath);
-        free(save->data);
-        return;
+        return 0;
     }
 
     gzres = gzwrite(f, save->data, save->size);
@@ -1578,43 +2188,261 @@ static void savestates_save_m64p_work(struct work_struct *work)
     {
         main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not write data to state file: %s", save->filepath);
         gzclose(f);
-        free(save->data);
-        return;
+        return 0;
     }
 
     gzclose(f);
-    main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Saved state to: %s", namefrompath(save->filepath));
+    return 1;
+}
+
+static int savestates_deflate_chunk(struct savestate_chunks *chunks, unsigned int i)
+{
+    z_stream strm;
+    unsigned char *out;
+    uLong bound;
+    size_t offset = (size_t)i * SAVESTATE_CHUNK_SIZE;
+    size_t length = chunks->size - offset;
+
+    if (length > SAVESTATE_CHUNK_SIZE)
+        length = SAVESTATE_CHUNK_SIZE;
+
+    memset(&strm, 0, sizeof(strm));
+    /* windowBits + 16 writes a gzip header and trailer around the chunk */
+    if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return 0;
+
+    bound = deflateBound(&strm, (uLong)length);
+    out = malloc(bound);
+    if (out == NULL)
+    {
+        deflateEnd(&strm);
+        return 0;
+    }
+
+    strm.next_in = (Bytef *)(chunks->data + offset);
+    strm.avail_in = (uInt)length;
+    strm.next_out = out;
+    strm.avail_out = (uInt)bound;
+
+    if (deflate(&strm, Z_FINISH) != Z_STREAM_END)
+    {
+        deflateEnd(&strm);
+        free(out);
+        return 0;
+    }
+
+    chunks->out[i] = out;
+    chunks->out_size[i] = strm.total_out;
+    deflateEnd(&strm);
+    return 1;
+}
+
+/* Compresses chunks until none is left to pick. */
+static void savestates_deflate_chunks(struct savestate_chunks *chunks)
+{
+    unsigned int i;
+    int ok;
+
+    SDL_LockMutex(chunks->lock);
+    while (chunks->next < chunks->count)
+    {
+        i = chunks->next++;
+        SDL_UnlockMutex(chunks->lock);
+
+        ok = savestates_deflate_chunk(chunks, i);
+
+        SDL_LockMutex(chunks->lock);
+        if (!ok)
+            chunks->failed = 1;
+        if (++chunks->done == chunks->count)
+            SDL_CondSignal(chunks->finished);
+    }
+    SDL_UnlockMutex(chunks->lock);
+}
+
+static void savestates_put_chunks(struct savestate_chunks *chunks)
+{
+    unsigned int i;
+    int last;
+
+    SDL_LockMutex(chunks->lock);
+    last = (--chunks->refs == 0);
+    SDL_UnlockMutex(chunks->lock);
+
+    if (!last)
+        return;
+
+    for (i = 0; i < chunks->count; ++i)
+        free(chunks->out[i]);
+    SDL_DestroyCond(chunks->finished);
+    SDL_DestroyMutex(chunks->lock);
+    free(chunks->out);
+    free(chunks->out_size);
+    free(chunks);
+}
+
+static void savestates_deflate_chunks_work(struct work_struct *work)
+{
+    struct savestate_chunks_work *helper = container_of(work, struct savestate_chunks_work, work);
+
+    savestates_deflate_chunks(helper->chunks);
+    savestates_put_chunks(helper->chunks);
+    free(helper);
+}
+
+static int savestates_write_gzip_chunks(const struct savestate_work *save)
+{
+    struct savestate_chunks *chunks;
+    struct savestate_chunks_work *helper;
+    size_t i, helpers;
+    FILE *f;
+    int ret = 1;
+
+    chunks = calloc(1, sizeof(*chunks));
+    if (chunks == NULL)
+        return savestates_write_gzip(save, Z_DEFAULT_COMPRESSION);
+
+    chunks->data = save->data;
+    chunks->size = save->size;
+    chunks->count = (unsigned int)((save->size + SAVESTATE_CHUNK_SIZE - 1) / SAVESTATE_CHUNK_SIZE);
+    chunks->refs = 1;
+    chunks->out = calloc(chunks->count, sizeof(*chunks->out));
+    chunks->out_size = calloc(chunks->count, sizeof(*chunks->out_size));
+    chunks->lock = SDL_CreateMutex();
+    chunks->finished = SDL_CreateCond();
+    if (chunks->out == NULL || chunks->out_size == NULL || chunks->lock == NULL || chunks->finished == NULL)
+    {
+        if (chunks->finished != NULL)
+            SDL_DestroyCond(chunks->finished);
+        if (chunks->lock != NULL)
+            SDL_DestroyMutex(chunks->lock);
+        free(chunks->out);
+        free(chunks->out_size);
+        free(chunks);
+        return savestates_write_gzip(save, Z_DEFAULT_COMPRESSION);
+    }
+
+    /* the other threads help with the chunks, this one compresses too
+     * so the save completes even if they are all busy */
+    helpers = workqueue_threads_count() - 1;
+    if (helpers > chunks->count - 1)
+        helpers = chunks->count - 1;
+
+    for (i = 0; i < helpers; ++i)
+    {
+        helper = malloc(sizeof(*helper));
+        if (helper == NULL)
+            break;
+
+        helper->chunks = chunks;
+        SDL_LockMutex(chunks->lock);
+        ++chunks->refs;
+        SDL_UnlockMutex(chunks->lock);
+
+        init_work(&helper->work, savestates_deflate_chunks_work);
+        queue_work(&helper->work);
+    }
+
+    savestates_deflate_chunks(chunks);
+
+    SDL_LockMutex(chunks->lock);
+    while (chunks->done != chunks->count)
+        SDL_CondWait(chunks->finished, chunks->lock);
+    SDL_UnlockMutex(chunks->lock);
+
+    if (chunks->failed)
+    {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not compress state: %s", save->filepath);
+        ret = 0;
+    }
+    else if ((f = osal_file_open(save->filepath, "wb")) == NULL)
+    {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not open state file: %s", save->filepath);
+        ret = 0;
+    }
+    else
+    {
+        for (i = 0; i < chunks->count && ret; ++i)
+            ret = (fwrite(chunks->out[i], 1, chunks->out_size[i], f) == chunks->out_size[i]);
+
+        if (fclose(f) != 0)
+            ret = 0;
+
+        if (!ret)
+            main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Could not write data to state file: %s", save->filepath);
+    }
+
+    savestates_put_chunks(chunks);
+    return ret;
+}
+
+static void savestates_save_m64p_work(struct work_struct *work)
+{
+    int ret;
+    unsigned int i;
+    struct savestate_prefetch_work *prefetch = NULL;
+    struct savestate_work *save = container_of(work, struct savestate_work, work);
+
+    /* saves are written in order, but the lock isn't held while compressing:
+     * the emulation thread takes it to select slots and to prefetch them */
+    SDL_LockMutex(savestates_lock);
+    while (save->ticket != save_ticket_done)
+        SDL_CondWait(savestates_saved, savestates_lock);
+    SDL_UnlockMutex(savestates_lock);
+
+    switch (save->compression)
+    {
+        case SAVESTATES_COMPRESSION_NONE: ret = savestates_write_gzip(save, Z_NO_COMPRESSION); break;
+        case SAVESTATES_COMPRESSION_FAST: ret = savestates_write_gzip(save, Z_BEST_SPEED); break;
+        default: ret = savestates_write_gzip_chunks(save); break;
+    }
+
+    if (ret)
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Saved state to: %s", namefrompath(save->filepath));
+
+    SDL_LockMutex(savestates_lock);
+
+    /* prefetched copies of the file are outdated now, and so is
+     * a prefetch of the slot that may have read it while it was written */
+    for (i = 0; i < 10; ++i)
+    {
+        if (prefetch_slots[i].filepath != NULL && strcmp(prefetch_slots[i].filepath, save->filepath) == 0)
+            savestates_prefetch_free(&prefetch_slots[i]);
+    }
+    if (save->slot >= 0)
+        ++prefetch_slots[save->slot].generation;
+
+    if (ret && save->slot >= 0 && savestates_prefetch_wanted((unsigned int)save->slot))
+        prefetch = savestates_prefetch_request((unsigned int)save->slot, strdup(save->filepath));
+
+    ++save_ticket_done;
+    SDL_CondBroadcast(savestates_saved);
+    SDL_UnlockMutex(savestates_lock);
+
+    if (prefetch != NULL)
+        queue_work(&prefetch->work);
+
     free(save->data);
     free(save->filepath);
     free(save);
-
-    SDL_UnlockMutex(savestates_lock);
 }
 
-static int savestates_save_m64p(const struct device* dev, char *filepath)
+/* Serializes the device state in Mupen64Plus format (uncompressed, header included).
+ * *data is reused when *capacity is large enough, otherwise it is reallocated.
+ * Returns the size of the serialized state, or 0 on failure. */
+static size_t savestates_serialize_m64p(const struct device* dev, char **data, size_t *capacity)
 {
     unsigned char outbuf[4];
     int i;
+    size_t size;
 
     char queue[1024];
 
-    struct savestate_work *save;
     char *curr;
 
     /* OK to cast away const qualifier */
     const uint32_t* cp0_regs = r4300_cp0_regs((struct cp0*)&dev->r4300.cp0);
 
-    save = malloc(sizeof(*save));
-    if (!save) {
-        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Insufficient memory to save state.");
-        return 0;
-    }
-
-    save->filepath = strdup(filepath);
-
-    if(autoinc_save_slot)
-        savestates_inc_slot();
-
     save_eventqueue_infos(&dev->r4300.cp0, queue);
 
     // Allocate memory for the save state data
@@ -1626,23 +2454,28 @@ static int savestates_save_m64p(const struct device* dev, char *filepath)
     {
         VCRlen = VCR_CollectSTData(&VCRbuf);
     }
-    save->size = 16788288 + sizeof(queue) + 4 + 4096 + 8 + VCRlen;  //8 is for isMovie and length
+    size = 16788288 + sizeof(queue) + 4 + 4096 + 8 + VCRlen;  //8 is for isMovie and length
 #else
-    save->size = 16788288 + sizeof(queue) + 4 + 4096;
+    size = 16788288 + sizeof(queue) + 4 + 4096;
 #endif
-    save->data = curr = malloc(save->size);
-    if (save->data == NULL)
+    if (*data == NULL || *capacity < size)
     {
-        free(save->filepath);
-        free(save);
+        /* Grow the caller's buffer, which is reused across saves when possible */
+        char *newdata = realloc(*data, size);
+        if (newdata == NULL)
+        {
 #ifdef VCR_SUPPORT
-        free(VCRbuf);
+            free(VCRbuf);
 #endif
-        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Insufficient memory to save state.");
-        return 0;
+            main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Insufficient memory to save state.");
+            return 0;
+        }
+        *data = newdata;
+        *capacity = size;
     }
+    curr = *data;
 
-    memset(save->data, 0, save->size);
+    memset(*data, 0, size);
 
     // Write the save state data to memory
     PUTARRAY(savestate_magic, curr, unsigned char, 8);
@@ -1859,7 +2692,7 @@ static int savestates_save_m64p(const struct device* dev, char *filepath)
 #endif
 
 #ifdef VCR_SUPPORT
-    int off = curr - save->data; //last offset...
+    int off = curr - *data; //last offset...
 #endif
     PUTDATA(curr, uint32_t, dev->ai.last_read);
     PUTDATA(curr, uint32_t, dev->ai.delayed_carry);
@@ -2005,7 +2838,7 @@ static int savestates_save_m64p(const struct device* dev, char *filepath)
     PUTDATA(curr, uint64_t, *r4300_cp2_latch((struct cp2*)&dev->r4300.cp2));
     
 #ifdef VCR_SUPPORT
-    curr = save->data+off+4096; //the previous section was supposed to be 0x1000 long >:(
+    curr = *data+off+4096; //the previous section was supposed to be 0x1000 long >:(
     PUTDATA(curr, uint32_t, VCR_IsPlaying());
     if (VCRbuf != NULL)
     {
@@ -2015,11 +2848,57 @@ static int savestates_save_m64p(const struct device* dev, char *filepath)
     }
 #endif
 
+    return size;
+}
+
+static int savestates_save_m64p(const struct device* dev, char *filepath)
+{
+    struct savestate_work *save;
+    size_t capacity = 0;
+
+    save = malloc(sizeof(*save));
+    if (!save) {
+        main_message(M64MSG_STATUS, OSD_BOTTOM_LEFT, "Insufficient memory to save state.");
+        return 0;
+    }
+
+    save->filepath = strdup(filepath);
+    save->slot = (fname == NULL) ? (int)slot : -1;
+
+    if(autoinc_save_slot)
+        savestates_inc_slot();
+
+    save->data = NULL;
+    save->size = savestates_serialize_m64p(dev, &save->data, &capacity);
+    if (save->size == 0)
+    {
+        free(save->filepath);
+        free(save);
+        return 0;
+    }
+
+    save->compression = compression;
+    save->ticket = save_ticket_next++;
     init_work(&save->work, savestates_save_m64p_work);
     queue_work(&save->work);
     return 1;
 }
 
+static int savestates_save_m64p_mem(const struct device* dev, unsigned int s)
+{
+    struct savestate_mem_slot* mem = &mem_slots[s];
+    size_t size;
+
+    /* on failure the previous contents of the slot are left untouched */
+    size = savestates_serialize_m64p(dev, &mem->data, &mem->capacity);
+    if (size == 0)
+        return 0;
+
+    mem->size = size;
+    DebugMessage(M64MSG_VERBOSE, "Saved state to memory slot %u", s);
+    return 1;
+}
+
 static int savestates_save_pj64(const struct device* dev,
                                 char *filepath, void *handle,
                                 int (*write_func)(void *, const void *, size_t))
@@ -2268,6 +3147,15 @@ int savestates_save(void)
         get_next_event_type(&dev->r4300.cp0.q) > COMPARE_INT)
         return 0;
 
+    if (type == savestates_type_m64p_mem)
+    {
+        ret = savestates_save_m64p_mem(dev, mem_slot);
+
+        StateChanged(M64CORE_STATE_SAVECOMPLETE, ret);
+        savestates_clear_job();
+        return ret;
+    }
+
     if (fname != NULL && type == savestates_type_unknown)
         type = savestates_type_m64p;
     else if (fname == NULL) // Always save slots in M64P format
@@ -2293,6 +3181,16 @@ int savestates_save(void)
     return ret;
 }
 
+size_t savestates_save_to_buffer(char **data, size_t *capacity)
+{
+    return savestates_serialize_m64p(&g_dev, data, capacity);
+}
+
+int savestates_load_from_buffer(const char *data, size_t size)
+{
+    return savestates_load_m64p_buffer(&g_dev, data, size);
+}
+
 void savestates_init(void)
 {
     savestates_lock = SDL_CreateMutex();
@@ -2300,10 +3198,28 @@ void savestates_init(void)
         DebugMessage(M64MSG_ERROR, "Could not create savestates list lock");
         return;
     }
+
+    savestates_saved = SDL_CreateCond();
+    if (!savestates_saved) {
+        DebugMessage(M64MSG_ERROR, "Could not create savestates condition");
+        return;
+    }
 }
 
 void savestates_deinit(void)
 {
+    unsigned int i;
+
+    SDL_DestroyCond(savestates_saved);
     SDL_DestroyMutex(savestates_lock);
     savestates_clear_job();
+
+    for (i = 0; i < SAVESTATES_MEM_SLOTS_COUNT; ++i)
+    {
+        free(mem_slots[i].data);
+        memset(&mem_slots[i], 0, sizeof(mem_slots[i]));
+    }
+
+    for (i = 0; i < 10; ++i)
+        savestates_prefetch_free(&prefetch_slots[i]);
 }
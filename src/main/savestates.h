@@ -25,6 +25,8 @@
 #ifndef __SAVESTAVES_H__
 #define __SAVESTAVES_H__
 
+#include <stddef.h>
+
 typedef enum _savestates_job
 {
     savestates_job_nothing,
@@ -37,20 +39,38 @@ typedef enum _savestates_type
     savestates_type_unknown,
     savestates_type_m64p,
     savestates_type_pj64_zip,
-    savestates_type_pj64_unc
+    savestates_type_pj64_unc,
+    savestates_type_m64p_mem
 } savestates_type;
 
+enum { SAVESTATES_MEM_SLOTS_COUNT = 10 };
+
+enum
+{
+    SAVESTATES_COMPRESSION_NONE,
+    SAVESTATES_COMPRESSION_FAST,
+    SAVESTATES_COMPRESSION_PARALLEL
+};
+
 savestates_job savestates_get_job(void);
 void savestates_set_job(savestates_job j, savestates_type t, const char *fn);
+void savestates_set_mem_job(savestates_job j, unsigned int s);
 void savestates_init(void);
 void savestates_deinit(void);
 
 int savestates_load(void);
 int savestates_save(void);
 
+/* Uncompressed Mupen64Plus state of the running emulator, kept in memory.
+ * These must only be called when it is safe to save/load a state. */
+size_t savestates_save_to_buffer(char **data, size_t *capacity);
+int savestates_load_from_buffer(const char *data, size_t size);
+
 void savestates_select_slot(unsigned int s);
 unsigned int savestates_get_slot(void);
 void savestates_set_autoinc_slot(int b);
+void savestates_set_compression(int c);
+void savestates_set_prefetch(int enable);
 void savestates_inc_slot(void);
 
 #endif /* __SAVESTAVES_H__ */
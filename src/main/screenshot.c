@@ -32,9 +32,11 @@
 #include "api/callbacks.h"
 #include "api/m64p_config.h"
 #include "api/m64p_types.h"
+#include "main/frame_pool.h"
 #include "main/main.h"
 #include "main/rom.h"
 #include "main/util.h"
+#include "main/workqueue.h"
 #include "osal/files.h"
 #include "osal/preproc.h"
 #include "osd/osd.h"
@@ -130,6 +132,27 @@ static int SaveRGBBufferToFile(const char *filename, const unsigned char *buf, i
 
 static int CurrentShotIndex;
 
+/* Screenshots are compressed and written by the workqueue. Past this many in
+ * flight, they are written right away instead of piling up frames. */
+#define SCREENSHOT_MAX_PENDING 16
+
+struct screenshot_work
+{
+    struct work_struct work;
+    struct frame_buffer *frame;
+    char *filename;
+    int frame_number;
+    int result;
+    struct screenshot_work *next;
+};
+
+static SDL_atomic_t l_PendingShots;
+
+/* Written screenshots, most recent first. They are reported by the emulation
+ * thread, the frontend doesn't expect callbacks from the workqueue. */
+static SDL_SpinLock l_DoneLock = 0;
+static struct screenshot_work *l_DoneShots = NULL;
+
 static char *GetNextScreenshotPath(void)
 {
     char *ScreenshotPath;
@@ -215,8 +238,67 @@ void ScreenshotRomOpen(void)
     CurrentShotIndex = 0;
 }
 
+static void SaveScreenshotWork(struct work_struct *work)
+{
+    struct screenshot_work *shot = container_of(work, struct screenshot_work, work);
+    struct frame_buffer *frame = shot->frame;
+
+    // write the image to a PNG
+    shot->result = SaveRGBBufferToFile(shot->filename, frame->pixels, frame->width, frame->height, frame->width * 3);
+    // give the buffer back to the pool
+    frame_buffer_unref(frame);
+    free(shot->filename);
+
+    SDL_AtomicLock(&l_DoneLock);
+    shot->next = l_DoneShots;
+    l_DoneShots = shot;
+    SDL_AtomicUnlock(&l_DoneLock);
+    SDL_AtomicAdd(&l_PendingShots, -1);
+}
+
+void ScreenshotReportCaptured(void)
+{
+    struct screenshot_work *shot, *shots = NULL;
+
+    SDL_AtomicLock(&l_DoneLock);
+    while ((shot = l_DoneShots) != NULL)
+    {
+        /* reversed to report them in the order they were taken */
+        l_DoneShots = shot->next;
+        shot->next = shots;
+        shots = shot;
+    }
+    SDL_AtomicUnlock(&l_DoneLock);
+
+    while ((shot = shots) != NULL)
+    {
+        shots = shot->next;
+        // print message -- this allows developers to capture frames and use them in the regression test
+        if (shot->result != 0)
+        {
+            StateChanged(M64CORE_SCREENSHOT_CAPTURED, 0);
+        }
+        else
+        {
+            main_message(M64MSG_INFO, OSD_BOTTOM_LEFT, "Captured screenshot for frame %i.", shot->frame_number);
+            StateChanged(M64CORE_SCREENSHOT_CAPTURED, 1);
+        }
+        free(shot);
+    }
+}
+
+void ScreenshotRomClosed(void)
+{
+    /* the workqueue may still be writing some, there are at most SCREENSHOT_MAX_PENDING */
+    while (SDL_AtomicGet(&l_PendingShots) > 0)
+        SDL_Delay(1);
+
+    ScreenshotReportCaptured();
+}
+
 void TakeScreenshot(int iFrameNumber)
 {
+    struct screenshot_work *shot;
     char *filename;
 
     // look for an unused screenshot filename
@@ -227,14 +309,8 @@ void TakeScreenshot(int iFrameNumber)
         return;
     }
 
-    // get the width and height
-    int width = 640;
-    int height = 480;
-    gfx.readScreen(NULL, &width, &height, 0);
-
-    // allocate memory for the image
-    unsigned char *pucFrame = (unsigned char *) malloc(width * height * 3);
-    if (pucFrame == NULL)
+    shot = malloc(sizeof(*shot));
+    if (shot == NULL)
     {
         StateChanged(M64CORE_SCREENSHOT_CAPTURED, 0);
         free(filename);
@@ -242,22 +318,28 @@ void TakeScreenshot(int iFrameNumber)
     }
 
     // grab the back image from OpenGL by calling the video plugin
-    gfx.readScreen(pucFrame, &width, &height, 0);
-
-    // write the image to a PNG
-    int rval = SaveRGBBufferToFile(filename, pucFrame, width, height, width * 3);
-    // free the memory
-    free(pucFrame);
-    free(filename);
-    // print message -- this allows developers to capture frames and use them in the regression test
-    if (rval != 0)
+    shot->frame = frame_pool_grab(0);
+    if (shot->frame == NULL)
     {
         StateChanged(M64CORE_SCREENSHOT_CAPTURED, 0);
+        free(filename);
+        free(shot);
+        return;
+    }
+
+    // only the grab has to happen in the render path, the rest is done in the background
+    shot->filename = filename;
+    shot->frame_number = iFrameNumber;
+    init_work(&shot->work, SaveScreenshotWork);
+
+    if (SDL_AtomicIncRef(&l_PendingShots) >= SCREENSHOT_MAX_PENDING)
+    {
+        SaveScreenshotWork(&shot->work);
+        ScreenshotReportCaptured();
     }
     else
     {
-        main_message(M64MSG_INFO, OSD_BOTTOM_LEFT, "Captured screenshot for frame %i.", iFrameNumber);
-        StateChanged(M64CORE_SCREENSHOT_CAPTURED, 1);
+        queue_work(&shot->work);
     }
 }
 
@@ -24,5 +24,7 @@
 
 void ScreenshotRomOpen(void);
 void TakeScreenshot(int iFrameNumber);
+void ScreenshotReportCaptured(void);
+void ScreenshotRomClosed(void);
 
 #endif
@@ -0,0 +1,97 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - state_delta.c                                           *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* A delta is the XOR of two emulator snapshots with runs of identical words
+ * skipped, stored as [skip count][literal count][literals...] records of
+ * 32-bit words. Applying it to either snapshot gives the other one. */
+
+#include "state_delta.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+size_t state_delta_words(size_t a, size_t b)
+{
+    return (((a > b) ? a : b) + 3) / 4;
+}
+
+int state_delta_pad(char **buffer, size_t *capacity, size_t size, size_t words)
+{
+    if (*capacity < words * 4)
+    {
+        char *newbuffer = realloc(*buffer, words * 4);
+        if (newbuffer == NULL)
+            return 0;
+
+        *buffer = newbuffer;
+        *capacity = words * 4;
+    }
+
+    memset(*buffer + size, 0, words * 4 - size);
+    return 1;
+}
+
+size_t state_delta_encode(uint32_t *out, const uint32_t *older, const uint32_t *newer, size_t words)
+{
+    size_t i = 0, n = 0;
+
+    while (i < words)
+    {
+        size_t skip = i;
+        size_t literal;
+
+        while (i < words && older[i] == newer[i])
+            ++i;
+        skip = i - skip;
+
+        literal = i;
+        while (i < words && older[i] != newer[i])
+            ++i;
+
+        if (out != NULL)
+        {
+            size_t k;
+
+            out[n] = (uint32_t)skip;
+            out[n + 1] = (uint32_t)(i - literal);
+            for (k = literal; k < i; ++k)
+                out[n + 2 + k - literal] = older[k] ^ newer[k];
+        }
+        n += 2 + (i - literal);
+    }
+
+    return n;
+}
+
+void state_delta_apply(uint32_t *state, const uint32_t *delta, size_t length)
+{
+    size_t i = 0, pos = 0;
+
+    while (i < length)
+    {
+        uint32_t skip = delta[i++];
+        uint32_t count = delta[i++];
+
+        pos += skip;
+        while (count-- > 0)
+            state[pos++] ^= delta[i++];
+    }
+}
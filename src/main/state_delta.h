@@ -0,0 +1,41 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - state_delta.h                                           *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __STATE_DELTA_H__
+#define __STATE_DELTA_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Number of 32-bit words needed to hold the larger of two states of a and b bytes. */
+size_t state_delta_words(size_t a, size_t b);
+
+/* Grows buffer to hold words 32-bit words, zeroing everything past size. */
+int state_delta_pad(char **buffer, size_t *capacity, size_t size, size_t words);
+
+/* Encodes older ^ newer into out and returns its length in words.
+ * With out == NULL only the length is computed. */
+size_t state_delta_encode(uint32_t *out, const uint32_t *older, const uint32_t *newer, size_t words);
+
+/* Turns state into the other state of an encoded pair. */
+void state_delta_apply(uint32_t *state, const uint32_t *delta, size_t length);
+
+#endif /* __STATE_DELTA_H__ */
@@ -27,7 +27,7 @@
 #define MUPEN_CORE_NAME "Mupen64Plus Core"
 #define MUPEN_CORE_VERSION 0x020509
 
-#define FRONTEND_API_VERSION 0x020106
+#define FRONTEND_API_VERSION 0x020107
 #define CONFIG_API_VERSION   0x020302
 #define DEBUG_API_VERSION    0x020001
 #define VIDEXT_API_VERSION   0x030300
@@ -31,12 +31,13 @@
 #include "api/m64p_types.h"
 #include "main/list.h"
 
-#define WORKQUEUE_THREADS 1
+#define WORKQUEUE_MAX_THREADS 8
 
 struct workqueue_mgmt_globals {
     struct list_head work_queue;
     struct list_head thread_queue;
     struct list_head thread_list;
+    size_t threads_count;
     SDL_mutex *lock;
 };
 
@@ -99,6 +100,7 @@ static int workqueue_thread_handler(void *data)
 int workqueue_init(void)
 {
     size_t i;
+    int cpus;
     struct workqueue_thread *thread;
 
     memset(&workqueue_mgmt, 0, sizeof(workqueue_mgmt));
@@ -112,8 +114,18 @@ int workqueue_init(void)
         return -1;
     }
 
+    /* one thread per CPU, work items must not rely on being run in order */
+#if SDL_VERSION_ATLEAST(2,0,0)
+    cpus = SDL_GetCPUCount();
+#else
+    cpus = 1;
+#endif
+    workqueue_mgmt.threads_count = (cpus < 1) ? 1 : (size_t)cpus;
+    if (workqueue_mgmt.threads_count > WORKQUEUE_MAX_THREADS)
+        workqueue_mgmt.threads_count = WORKQUEUE_MAX_THREADS;
+
     SDL_LockMutex(workqueue_mgmt.lock);
-    for (i = 0; i < WORKQUEUE_THREADS; i++) {
+    for (i = 0; i < workqueue_mgmt.threads_count; i++) {
         thread = malloc(sizeof(*thread));
         if (!thread) {
             DebugMessage(M64MSG_ERROR, "Could not create workqueue thread management data");
@@ -154,7 +166,7 @@ void workqueue_shutdown(void)
     struct work_struct *work;
     struct workqueue_thread *thread, *safe;
 
-    for (i = 0; i < WORKQUEUE_THREADS; i++) {
+    for (i = 0; i < workqueue_mgmt.threads_count; i++) {
         work = malloc(sizeof(*work));
         init_work(work, workqueue_dismiss);
         queue_work(work);
@@ -189,3 +201,8 @@ int queue_work(struct work_struct *work)
 
     return 0;
 }
+
+size_t workqueue_threads_count(void)
+{
+    return workqueue_mgmt.threads_count;
+}
@@ -22,6 +22,8 @@
 #ifndef __WORKQUEUE_H__
 #define __WORKQUEUE_H__
 
+#include <stddef.h>
+
 #include "list.h"
 #include "osal/preproc.h"
 
@@ -44,6 +46,7 @@ static osal_inline void init_work(struct work_struct *work, work_func_t func)
 int workqueue_init(void);
 void workqueue_shutdown(void);
 int queue_work(struct work_struct *work);
+size_t workqueue_threads_count(void);
 
 #else
 
@@ -62,6 +65,11 @@ static osal_inline int queue_work(struct work_struct *work)
     return 0;
 }
 
+static osal_inline size_t workqueue_threads_count(void)
+{
+    return 1;
+}
+
 #endif
 
 #endif
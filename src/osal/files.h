@@ -26,6 +26,7 @@
 #if !defined (OSAL_FILES_H)
 #define OSAL_FILES_H
 
+#include <stdint.h>
 #include <stdio.h>
 #include <zlib.h>
 
@@ -68,4 +69,28 @@ extern const char * osal_get_user_cachepath(void);
 extern FILE * osal_file_open (const char *filename, const char *mode);
 extern gzFile osal_gzopen(const char *filename, const char *mode);
 
+/* Get the last modification time of a file, in nanoseconds since the epoch.
+ * Returns zero on success, nonzero on failure.
+ */
+extern int osal_file_mtime(const char *filename, int64_t *mtime);
+
+/* Map length bytes of a file, starting at offset, read-only into memory.
+ * Returns a pointer to the first byte, or NULL on failure. The mapping stays
+ * valid until osal_file_unmap() is called with the returned handle.
+ *
+ * Reading a mapping past the end of a file that was truncated afterwards
+ * crashes (SIGBUS), whatever the mapping flags. Files that may be mapped must
+ * be truncated with osal_file_open_truncate(), which fails while they are.
+ * Other programs truncating the file aren't guarded against on Unix; on Windows
+ * the file can't be truncated while it is mapped.
+ */
+extern const void * osal_file_map(const char *filename, size_t offset, size_t length, void **handle);
+extern void osal_file_unmap(void *handle);
+
+/* Same as osal_file_open(filename, "wb+"), but fails with errno set to EBUSY
+ * instead of truncating a file that osal_file_map() has mapped, in this
+ * process or another one.
+ */
+extern FILE * osal_file_open_truncate(const char *filename);
+
 #endif /* OSAL_FILES_H */
@@ -27,6 +27,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -241,3 +245,111 @@ gzFile osal_gzopen(const char *filename, const char *mode)
 {
     return gzopen(filename, mode);
 }
+
+int osal_file_mtime(const char *filename, int64_t *mtime)
+{
+    struct stat fileinfo;
+
+    if (stat(filename, &fileinfo) != 0)
+        return 1;
+
+    *mtime = (int64_t)fileinfo.st_mtim.tv_sec * 1000000000 + fileinfo.st_mtim.tv_nsec;
+    return 0;
+}
+
+struct osal_file_mapping
+{
+    void *base;
+    size_t length;
+    int fd;     /* holds a shared lock, see osal_file_open_truncate */
+};
+
+const void * osal_file_map(const char *filename, size_t offset, size_t length, void **handle)
+{
+    struct osal_file_mapping *mapping;
+    struct stat fileinfo;
+    void *base;
+    int fd;
+
+    if (length == 0)
+        return NULL;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    /* the lock is taken before the size is checked, the file can't shrink after that */
+    if (flock(fd, LOCK_SH | LOCK_NB) != 0
+     || fstat(fd, &fileinfo) != 0 || (uint64_t)fileinfo.st_size < (uint64_t)offset + length)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    base = mmap(NULL, offset + length, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+        close(fd);
+        return NULL;
+    }
+
+#if defined(MADV_SEQUENTIAL)
+    madvise(base, offset + length, MADV_SEQUENTIAL);
+#endif
+
+    mapping = malloc(sizeof(*mapping));
+    if (mapping == NULL)
+    {
+        munmap(base, offset + length);
+        close(fd);
+        return NULL;
+    }
+
+    mapping->base = base;
+    mapping->length = offset + length;
+    mapping->fd = fd;
+    *handle = mapping;
+    return (const char *)base + offset;
+}
+
+void osal_file_unmap(void *handle)
+{
+    struct osal_file_mapping *mapping = handle;
+
+    if (mapping == NULL)
+        return;
+
+    munmap(mapping->base, mapping->length);
+    close(mapping->fd);
+    free(mapping);
+}
+
+FILE * osal_file_open_truncate(const char *filename)
+{
+    FILE *file;
+    int fd;
+
+    fd = open(filename, O_RDWR | O_CREAT, 0666);
+    if (fd < 0)
+        return NULL;
+
+    /* mappings hold a shared lock for as long as they exist */
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        close(fd);
+        errno = EBUSY;
+        return NULL;
+    }
+
+    if (ftruncate(fd, 0) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    flock(fd, LOCK_UN);
+
+    file = fdopen(fd, "wb+");
+    if (file == NULL)
+        close(fd);
+    return file;
+}
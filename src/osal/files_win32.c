@@ -220,3 +220,69 @@ gzFile osal_gzopen(const char *filename, const char *mode)
     MultiByteToWideChar(CP_UTF8, 0, filename, -1, wstr_filename, PATH_MAX);
     return gzopen_w(wstr_filename, mode);
 }
+
+int osal_file_mtime(const char *filename, int64_t *mtime)
+{
+    WIN32_FILE_ATTRIBUTE_DATA fileinfo;
+    ULARGE_INTEGER time;
+    wchar_t wstr_filename[PATH_MAX];
+    MultiByteToWideChar(CP_UTF8, 0, filename, -1, wstr_filename, PATH_MAX);
+
+    /* _wstat only has a resolution of one second */
+    if (!GetFileAttributesExW(wstr_filename, GetFileExInfoStandard, &fileinfo))
+        return 1;
+
+    /* 100 ns intervals since 1601, moved to the Unix epoch */
+    time.LowPart = fileinfo.ftLastWriteTime.dwLowDateTime;
+    time.HighPart = fileinfo.ftLastWriteTime.dwHighDateTime;
+    *mtime = ((int64_t)time.QuadPart - INT64_C(116444736000000000)) * 100;
+    return 0;
+}
+
+const void * osal_file_map(const char *filename, size_t offset, size_t length, void **handle)
+{
+    wchar_t wstr_filename[PATH_MAX];
+    LARGE_INTEGER size;
+    HANDLE file, mapping;
+    void *base;
+
+    if (length == 0)
+        return NULL;
+
+    MultiByteToWideChar(CP_UTF8, 0, filename, -1, wstr_filename, PATH_MAX);
+    file = CreateFileW(wstr_filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    if (!GetFileSizeEx(file, &size) || (uint64_t)size.QuadPart < (uint64_t)offset + length)
+    {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+        return NULL;
+
+    /* the view keeps the mapping and the file referenced after their handles are closed */
+    base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, offset + length);
+    CloseHandle(mapping);
+    if (base == NULL)
+        return NULL;
+
+    *handle = base;
+    return (const char *)base + offset;
+}
+
+void osal_file_unmap(void *handle)
+{
+    if (handle != NULL)
+        UnmapViewOfFile(handle);
+}
+
+FILE * osal_file_open_truncate(const char *filename)
+{
+    /* Windows already refuses to truncate a mapped file */
+    return osal_file_open(filename, "wb+");
+}
@@ -0,0 +1,134 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - event_slot_bench.c                                       *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Times event_slot, which the interrupt queue calls for every lookup, add
+ * and removal of an event, against the two other ways it was written: a
+ * table indexed by the type modulo 37, and a plain shift loop.
+ *
+ * Each lookup picks the type of the next one, so the times are latencies
+ * and the compiler can't fold or vectorize the loop. The types follow a
+ * mix of DMA completions, VI and COMPARE, with a few unknown ones.
+ *
+ * From the root of the source tree:
+ *   gcc -O2 -Isrc -o event_slot_bench tools/event_slot_bench.c && ./event_slot_bench
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "device/r4300/event_slot.h"
+
+enum { TYPES_COUNT = 4096, LOOKUPS = 50000000, RUNS = 5 };
+
+static int types[TYPES_COUNT];
+
+static int slot_table(int type)
+{
+    static const signed char bit_numbers[37] = {
+        -1,  0,  1, 26,  2, 23, 27, -1,  3, 16,
+        24, 30, 28, 11, -1, 13,  4,  7, 17, -1,
+        25, 22, 31, 15, 29, 10, 12,  6, -1, 21,
+        14,  9,  5, 20,  8, 19, 18
+    };
+    uint32_t bit = (uint32_t)type;
+
+    if (bit == 0 || (bit & (bit - 1)) != 0 || bit > DD_DV_INT) {
+        return -1;
+    }
+
+    return bit_numbers[bit % 37];
+}
+
+static int slot_loop(int type)
+{
+    uint32_t bit = (uint32_t)type;
+    int index = 0;
+
+    if (bit == 0 || (bit & (bit - 1)) != 0 || bit > DD_DV_INT) {
+        return -1;
+    }
+
+    while ((bit & 1) == 0) {
+        bit >>= 1;
+        ++index;
+    }
+    return index;
+}
+
+static int slot_current(int type)
+{
+    return event_slot(type);
+}
+
+static double time_slots(int (*slot)(int), unsigned int* sum)
+{
+    clock_t start = clock();
+    unsigned int i, next = 0;
+
+    for (i = 0; i < LOOKUPS; ++i) {
+        next = (next + 2 + (unsigned int)slot(types[next])) & (TYPES_COUNT - 1);
+    }
+
+    *sum += next;
+    return (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / LOOKUPS;
+}
+
+int main(void)
+{
+    static const int mix[16] = {
+        SI_INT, PI_INT, PI_INT, AI_INT, AI_INT, SP_INT, SP_INT, DP_INT,
+        DP_INT, RSP_DMA_EVT, VI_INT, COMPARE_INT, CHECK_INT, SPECIAL_INT, 0x3, 0x8000
+    };
+    static const char* const names[3] = { "modulo 37 table", "shift loop", "event_slot" };
+    int (* const slots[3])(int) = { slot_table, slot_loop, slot_current };
+    double best[3] = { 0, 0, 0 };
+    unsigned int sum = 0;
+    uint32_t seed = 1;
+    int i, run;
+
+    for (i = 0; i < TYPES_COUNT; ++i) {
+        seed = seed * 1103515245 + 12345;
+        types[i] = mix[(seed >> 16) & 15];
+    }
+
+    for (i = 0; i < 1 << 16; ++i) {
+        int type = (i < 32) ? (1 << i) : i;
+        if (slot_table(type) != event_slot(type) || slot_loop(type) != event_slot(type)) {
+            printf("slot mismatch for type %x\n", type);
+            return 1;
+        }
+    }
+
+    /* the runs of each variant are interleaved, the best one is kept */
+    for (run = 0; run < RUNS; ++run) {
+        for (i = 0; i < 3; ++i) {
+            double ns = time_slots(slots[i], &sum);
+            if (run == 0 || ns < best[i])
+                best[i] = ns;
+        }
+    }
+
+    for (i = 0; i < 3; ++i)
+        printf("%-16s %.2f ns per lookup\n", names[i], best[i]);
+
+    return sum == 0xffffffff;
+}
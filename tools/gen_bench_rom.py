@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+'''* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - gen_bench_rom.py                                        *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+
+Writes a ROM to compare the R4300 emulators without a commercial ROM.
+
+It holds many routines of random ALU, load and store instructions. 16 of
+them run in a hot loop, the others are called a few at a time, in turns,
+so most of the code runs rarely like the setup code of a game. Nothing is
+displayed and the ROM never ends.
+
+Usage:
+
+python3 gen_bench_rom.py bench.z64 [routines]
+
+Run it with a core built with DBG_TIMING=1 to get the time spent in the
+dynarec compiler, e.g. with --emumode 1, 2 and 3.
+'''
+
+import random
+import struct
+import sys
+
+BASE = 0x80000400
+
+t0, t1, t2, t3, t4, t5, t6, t7 = range(8, 16)
+s0, s1, s3, s4 = 16, 17, 19, 20
+t8, t9, ra, zero = 24, 25, 31, 0
+
+def r_type(rs, rt, rd, sa, funct): return (rs << 21) | (rt << 16) | (rd << 11) | (sa << 6) | funct
+def i_type(op, rs, rt, imm): return (op << 26) | (rs << 21) | (rt << 16) | (imm & 0xffff)
+
+def addiu(rt, rs, imm): return i_type(9, rs, rt, imm)
+def ori(rt, rs, imm): return i_type(13, rs, rt, imm)
+def lui(rt, imm): return i_type(15, 0, rt, imm)
+def lw(rt, off, base): return i_type(35, base, rt, off)
+def sw(rt, off, base): return i_type(43, base, rt, off)
+def addu(rd, rs, rt): return r_type(rs, rt, rd, 0, 0x21)
+def xor(rd, rs, rt): return r_type(rs, rt, rd, 0, 0x26)
+def sll(rd, rt, sa): return r_type(0, rt, rd, sa, 0)
+def jr(rs): return r_type(rs, 0, 0, 0, 8)
+def jalr(rs): return r_type(rs, 0, 31, 0, 9)
+def j(target): return (2 << 26) | ((target >> 2) & 0x3ffffff)
+def jal(target): return (3 << 26) | ((target >> 2) & 0x3ffffff)
+def bne(rs, rt, pc, target): return i_type(5, rs, rt, (target - pc - 4) >> 2)
+nop = 0
+
+def routine(rng):
+    regs = [t0, t1, t2, t3, t4, t5, t6, t7]
+    code = []
+    for i in range(64):
+        a, b, c = rng.choice(regs), rng.choice(regs), rng.choice(regs)
+        kind = rng.randrange(6)
+        if kind == 0:   code.append(lw(a, rng.randrange(0, 1024, 4), s0))
+        elif kind == 1: code.append(sw(a, rng.randrange(0, 1024, 4), s0))
+        elif kind == 2: code.append(addiu(a, b, rng.randrange(-100, 100)))
+        elif kind == 3: code.append(xor(a, b, c))
+        elif kind == 4: code.append(sll(a, b, rng.randrange(32)))
+        else:           code.append(addu(a, b, c))
+    return code + [jr(ra), nop]
+
+def main_loop(pc, routines, table):
+    code = []
+    def at(): return pc + 4 * len(code)
+
+    code += [lui(s0, 0x8020)]
+    # VI_V_SYNC_REG = 525, VI_V_INTR_REG = 2, for a vertical interrupt every frame
+    code += [lui(t0, 0xa440), ori(t1, zero, 0x20d), sw(t1, 0x18, t0), ori(t1, zero, 2), sw(t1, 0x0c, t0)]
+    code += [lui(s4, table >> 16), ori(s4, s4, table & 0xffff), ori(s1, zero, 0)]
+
+    outer = at()
+    code += [ori(s3, zero, 200)]
+    hot = at()
+    for h in range(16):
+        code += [jal(routines[h * (len(routines) // 16)]), nop]
+    code += [addiu(s3, s3, -1)]
+    code += [bne(s3, zero, at(), hot), nop]
+
+    for c in range(8):
+        code += [sll(t9, s1, 2), addu(t9, t9, s4), lw(t9, 0, t9), nop, jalr(t9), nop]
+        code += [addiu(s1, s1, 1), ori(t8, zero, len(routines))]
+        code += [bne(s1, t8, at(), at() + 12), nop, ori(s1, zero, 0)]
+    code += [j(outer), nop]
+    return code
+
+def ipl3():
+    # copy 1MB from the cartridge to BASE and jump there, like the boot code of games
+    pc = 0xa4000040
+    code = [lui(t0, 0xb000), ori(t0, t0, 0x1000), lui(t1, 0x8000), ori(t1, t1, 0x0400), lui(t2, 0x0010)]
+    loop = pc + 4 * len(code)
+    code += [lw(t3, 0, t0), addiu(t0, t0, 4), addiu(t2, t2, -4), sw(t3, 0, t1)]
+    code += [bne(t2, zero, pc + 4 * len(code), loop), addiu(t1, t1, 4)]
+    code += [lui(t4, 0x8000), ori(t4, t4, 0x0400), jr(t4), nop]
+    return code
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: python3 gen_bench_rom.py <rom> [routines]")
+        return 1
+    count = int(sys.argv[2]) if len(sys.argv) > 2 else 3000
+    rng = random.Random(1)
+
+    main_words = 256
+    words = [nop] * main_words
+    routines = []
+    for i in range(count):
+        routines.append(BASE + 4 * len(words))
+        words += routine(rng)
+    table = BASE + 4 * len(words)
+    words += routines
+    loop = main_loop(BASE, routines, table)
+    assert len(loop) <= main_words
+    words[:len(loop)] = loop
+
+    code = b''.join(struct.pack('>I', w & 0xffffffff) for w in words)
+    if len(code) > 0x100000:
+        print("Too many routines to fit in 1MB")
+        return 1
+
+    rom = bytearray(0x200000)
+    struct.pack_into('>IIII', rom, 0, 0x80371240, 0x0000000f, BASE, 0x1444)
+    rom[0x20:0x34] = b'R4300 BENCH         '
+    rom[0x3b:0x3f] = b'NBNE'
+    for i, w in enumerate(ipl3()):
+        struct.pack_into('>I', rom, 0x40 + 4 * i, w & 0xffffffff)
+    rom[0x1000:0x1000 + len(code)] = code
+
+    with open(sys.argv[1], 'wb') as f:
+        f.write(rom)
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,71 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus - st_delta_test.c                                         *
+ *   Mupen64Plus homepage: https://mupen64plus.org/                        *
+ *   Copyright (C) 2024 Mupen64plus development team                       *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Checks that a compact .st movie block can never have the length of a full
+ * copy of the inputs, which VCR_LoadMovieData checks first.
+ *
+ * From the root of the source tree:
+ *   gcc -o st_delta_test tools/st_delta_test.c && ./st_delta_test
+ */
+
+#include <stdio.h>
+
+#include "../src/VCR/st_delta.h"
+
+static int failures = 0;
+
+static void check(uint32_t prefix, uint32_t cur_sample, uint32_t length_samples)
+{
+    size_t words = ST_DeltaWords(prefix, cur_sample, length_samples);
+    size_t min_words = 8 + (size_t)cur_sample + 1 - prefix;
+
+    if (ST_IsFullCopy(words, cur_sample, length_samples) || words < min_words || words > min_words + 2)
+    {
+        printf("prefix %u, curSample %u, length_samples %u: %u words\n",
+               prefix, cur_sample, length_samples, (unsigned int)words);
+        ++failures;
+    }
+}
+
+int main(void)
+{
+    uint32_t prefix, cur_sample, length_samples;
+
+    /* both full copy lengths right after the unpadded length: prefix 4, and
+     * a movie seeked back to its last sample or one with 5 samples */
+    check(4, 4, 5);
+    check(4, 10, 11);
+    check(4, 11, 10);
+
+    for (prefix = 0; prefix < 16; ++prefix)
+        for (cur_sample = prefix; cur_sample < 64; ++cur_sample)
+            for (length_samples = cur_sample; length_samples < cur_sample + 16; ++length_samples)
+                check(prefix, cur_sample, length_samples);
+
+    if (failures != 0)
+    {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+
+    printf("ok\n");
+    return 0;
+}